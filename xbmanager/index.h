@@ -0,0 +1,54 @@
+/*********************************************************************/
+/* index                                                             */
+/*********************************************************************/
+
+#ifndef _INDEX_H_
+#define _INDEX_H_
+
+#include <cstddef>
+#include <functional>
+
+#include "../xbserial/command.h"
+
+namespace XB {
+
+  const std::size_t DEFAULT_INDEX_CAPACITY = 64;
+
+  // open addressing (linear probing) hash table keyed by Address64,
+  // not thread-safe: owners lock around it
+  template<typename T>
+    class AddressIndex {
+  public:
+    AddressIndex(std::size_t capacity = DEFAULT_INDEX_CAPACITY);
+    AddressIndex(const AddressIndex<T>& index);
+    ~AddressIndex();
+    AddressIndex<T>& operator=(const AddressIndex<T>& index);
+    T* find(Address64 key);
+    T& operator[](Address64 key);
+    bool erase(Address64 key);
+    void clear();
+    std::size_t size() const;
+    std::size_t capacity() const;
+    bool at(std::size_t slot, Address64* key, T** value);
+
+  private:
+    struct Slot {
+      Address64 key;
+      bool used;
+      T value;
+    };
+
+  private:
+    std::size_t probe(Address64 key) const;
+    void grow();
+
+  private:
+    Slot* slots_;
+    std::size_t capacity_;
+    std::size_t size_;
+  };
+}
+
+#include "index.t.h"
+
+#endif // _INDEX_H_
@@ -0,0 +1,163 @@
+/*********************************************************************/
+/* index                                                             */
+/*********************************************************************/
+
+namespace XB {
+
+  template<typename T>
+  AddressIndex<T>::AddressIndex(std::size_t capacity) {
+    capacity_ = 1;
+    while (capacity_ < capacity) {
+      capacity_ <<= 1;
+    }
+
+    slots_ = new Slot[capacity_];
+    for (std::size_t index = 0; index < capacity_; index++) {
+      slots_[index].used = false;
+    }
+    size_ = 0;
+  }
+
+  template<typename T>
+  AddressIndex<T>::AddressIndex(const AddressIndex<T>& index) {
+    slots_ = NULL;
+    *this = index;
+  }
+
+  template<typename T>
+  AddressIndex<T>::~AddressIndex() {
+    delete [] slots_;
+  }
+
+  template<typename T>
+  AddressIndex<T>& AddressIndex<T>::operator=(const AddressIndex<T>& index) {
+    if (this != &index) {
+      delete [] slots_;
+      capacity_ = index.capacity_;
+      size_ = index.size_;
+      slots_ = new Slot[capacity_];
+      for (std::size_t slot = 0; slot < capacity_; slot++) {
+	slots_[slot] = index.slots_[slot];
+      }
+    }
+
+    return *this;
+  }
+
+  template<typename T>
+  T* AddressIndex<T>::find(Address64 key) {
+    std::size_t slot = probe(key);
+    return slots_[slot].used ? &slots_[slot].value : NULL;
+  }
+
+  template<typename T>
+  T& AddressIndex<T>::operator[](Address64 key) {
+    std::size_t slot = probe(key);
+    if (!slots_[slot].used) {
+      // keep the load factor under 3/4 so probe sequences stay short
+      if (((size_ + 1) * 4) > (capacity_ * 3)) {
+	grow();
+	slot = probe(key);
+      }
+
+      slots_[slot].key = key;
+      slots_[slot].value = T();
+      slots_[slot].used = true;
+      size_++;
+    }
+
+    return slots_[slot].value;
+  }
+
+  template<typename T>
+  bool AddressIndex<T>::erase(Address64 key) {
+    std::size_t slot = probe(key);
+    if (!slots_[slot].used) {
+      return false;
+    }
+
+    // backward shift deletion, so no tombstones are needed
+    std::size_t mask = capacity_ - 1;
+    std::size_t next = slot;
+    while (true) {
+      next = (next + 1) & mask;
+      if (!slots_[next].used) {
+	break;
+      }
+
+      std::size_t home = std::hash<Address64>()(slots_[next].key) & mask;
+      if (((next - home) & mask) >= ((next - slot) & mask)) {
+	slots_[slot] = slots_[next];
+	slot = next;
+      }
+    }
+
+    slots_[slot].used = false;
+    slots_[slot].value = T();
+    size_--;
+
+    return true;
+  }
+
+  template<typename T>
+  void AddressIndex<T>::clear() {
+    for (std::size_t slot = 0; slot < capacity_; slot++) {
+      slots_[slot].used = false;
+      slots_[slot].value = T();
+    }
+    size_ = 0;
+  }
+
+  template<typename T>
+  std::size_t AddressIndex<T>::size() const {
+    return size_;
+  }
+
+  template<typename T>
+  std::size_t AddressIndex<T>::capacity() const {
+    return capacity_;
+  }
+
+  template<typename T>
+  bool AddressIndex<T>::at(std::size_t slot, Address64* key, T** value) {
+    if ((slot >= capacity_) || !slots_[slot].used) {
+      return false;
+    }
+
+    *key = slots_[slot].key;
+    *value = &slots_[slot].value;
+    return true;
+  }
+
+  template<typename T>
+  std::size_t AddressIndex<T>::probe(Address64 key) const {
+    std::size_t mask = capacity_ - 1;
+    std::size_t slot = std::hash<Address64>()(key) & mask;
+    while (slots_[slot].used && (slots_[slot].key != key)) {
+      slot = (slot + 1) & mask;
+    }
+
+    return slot;
+  }
+
+  template<typename T>
+  void AddressIndex<T>::grow() {
+    Slot* slots = slots_;
+    std::size_t capacity = capacity_;
+
+    capacity_ <<= 1;
+    slots_ = new Slot[capacity_];
+    for (std::size_t slot = 0; slot < capacity_; slot++) {
+      slots_[slot].used = false;
+    }
+
+    for (std::size_t slot = 0; slot < capacity; slot++) {
+      if (slots[slot].used) {
+	Slot& target = slots_[probe(slots[slot].key)];
+	target = slots[slot];
+      }
+    }
+
+    delete [] slots;
+  }
+}
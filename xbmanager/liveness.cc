@@ -0,0 +1,129 @@
+/*********************************************************************/
+/* liveness                                                          */
+/*********************************************************************/
+
+#include "liveness.h"
+
+namespace XB {
+
+  static long since(const struct timespec& start) {
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+    return (1000 * (long)(current.tv_sec - start.tv_sec)) + ((current.tv_nsec - start.tv_nsec) / 1000000);
+  }
+
+  LivenessMonitor::Entry::Entry(LivenessMonitor* monitor, Address64 address64) {
+    monitor_ = monitor;
+    address64_ = address64;
+    timeout_ = 0;
+    clock_gettime(CLOCK_MONOTONIC, &lastSeen_);
+    stale_ = false;
+  }
+
+  void LivenessMonitor::Entry::expired() {
+    monitor_->expired(this);
+  }
+
+
+  LivenessMonitor::LivenessMonitor() {
+    timerWheel_ = NULL;
+    listener_ = NULL;
+  }
+
+  LivenessMonitor::~LivenessMonitor() {
+  }
+
+  int LivenessMonitor::initialize(TimerWheel* timerWheel, LivenessListener* listener) {
+    timerWheel_ = timerWheel;
+    listener_ = listener;
+
+    return pthread_mutex_init(&entriesMutex_, NULL);
+  }
+
+  // the wheel must no longer be advancing
+  int LivenessMonitor::destroy() {
+    Address64 address64;
+    Entry** entry;
+    for (std::size_t slot = 0; slot < entries_.capacity(); slot++) {
+      if (entries_.at(slot, &address64, &entry)) {
+	timerWheel_->cancel(*entry);
+	delete *entry;
+      }
+    }
+    entries_.clear();
+
+    return pthread_mutex_destroy(&entriesMutex_);
+  }
+
+  int LivenessMonitor::track(Address64 address64, long interval) {
+    int result = pthread_mutex_lock(&entriesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    Entry*& entry = entries_[address64];
+    if (entry == NULL) {
+      entry = new Entry(this, address64);
+    }
+    entry->timeout_ = (STALE_INTERVALS * interval) + STALE_GRACE;
+    timerWheel_->arm(entry, entry->timeout_);
+
+    return pthread_mutex_unlock(&entriesMutex_);
+  }
+
+  void LivenessMonitor::seen(Address64 address64) {
+    if (pthread_mutex_lock(&entriesMutex_) != 0) {
+      return;
+    }
+
+    bool back = false;
+    Entry** entry = entries_.find(address64);
+    if (entry != NULL) {
+      clock_gettime(CLOCK_MONOTONIC, &(*entry)->lastSeen_);
+      if ((*entry)->stale_) {
+	(*entry)->stale_ = false;
+	timerWheel_->arm(*entry, (*entry)->timeout_);
+	back = true;
+      }
+    }
+
+    pthread_mutex_unlock(&entriesMutex_);
+
+    if (back) {
+      listener_->back(address64);
+    }
+  }
+
+  bool LivenessMonitor::isStale(Address64 address64) {
+    if (pthread_mutex_lock(&entriesMutex_) != 0) {
+      return false;
+    }
+
+    Entry** entry = entries_.find(address64);
+    bool stale = (entry != NULL) && (*entry)->stale_;
+
+    pthread_mutex_unlock(&entriesMutex_);
+
+    return stale;
+  }
+
+  void LivenessMonitor::expired(Entry* entry) {
+    if (pthread_mutex_lock(&entriesMutex_) != 0) {
+      return;
+    }
+
+    long remaining = entry->timeout_ - since(entry->lastSeen_);
+    if (remaining > 0) {
+      timerWheel_->arm(entry, remaining);
+    }
+    else {
+      entry->stale_ = true;
+    }
+
+    pthread_mutex_unlock(&entriesMutex_);
+
+    if (remaining <= 0) {
+      listener_->stale(entry->address64_);
+    }
+  }
+}
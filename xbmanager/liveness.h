@@ -0,0 +1,66 @@
+/*********************************************************************/
+/* liveness                                                          */
+/*********************************************************************/
+
+#ifndef _LIVENESS_H_
+#define _LIVENESS_H_
+
+#include <time.h>
+#include <pthread.h>
+
+#include "../xbserial/command.h"
+#include "index.h"
+#include "timer.h"
+
+namespace XB {
+
+  const long STALE_INTERVALS = 3;  // missed intervals before a module is considered stale
+  const long STALE_GRACE = 1000;  // ms, on top of them for routing and retries
+
+  class LivenessListener {
+  public:
+    virtual ~LivenessListener() {}
+    virtual void stale(Address64 address64) = 0;
+    virtual void back(Address64 address64) = 0;
+  };
+
+  // a frame only stamps its module's last-seen time, the module's timer on the wheel
+  // checks the stamp when it fires and re-arms itself for whatever time is left
+  class LivenessMonitor {
+  public:
+    LivenessMonitor();
+    ~LivenessMonitor();
+    int initialize(TimerWheel* timerWheel, LivenessListener* listener);
+    int destroy();
+    int track(Address64 address64, long interval);
+    void seen(Address64 address64);
+    bool isStale(Address64 address64);
+
+  private:
+    class Entry : public Timer {
+    public:
+      Entry(LivenessMonitor* monitor, Address64 address64);
+
+    protected:
+      void expired();
+
+    public:
+      LivenessMonitor* monitor_;
+      Address64 address64_;
+      long timeout_;
+      struct timespec lastSeen_;
+      bool stale_;
+    };
+
+  private:
+    void expired(Entry* entry);
+
+  private:
+    TimerWheel* timerWheel_;
+    LivenessListener* listener_;
+    AddressIndex<Entry*> entries_;
+    pthread_mutex_t entriesMutex_;
+  };
+}
+
+#endif // _LIVENESS_H_
@@ -5,223 +5,1243 @@
 #include "manager.h"
 
 #include <sstream>
+#include <algorithm>
 #include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 
 #include "../xbserial/log.h"
 
 namespace XB {
 
+  // numeric comparison, ignoring the leading zero bytes modules drop from short values
+  static bool parameterEquals(const Parameter& current, const Parameter& desired) {
+    unsigned short currentIndex = 0;
+    while ((currentIndex < current.length) && (current.data[currentIndex] == 0)) {
+      currentIndex++;
+    }
+
+    unsigned short desiredIndex = 0;
+    while ((desiredIndex < desired.length) && (desired.data[desiredIndex] == 0)) {
+      desiredIndex++;
+    }
+
+    unsigned short length = current.length - currentIndex;
+    if (length != (desired.length - desiredIndex)) {
+      return false;
+    }
+
+    return (length == 0) || (memcmp(current.data + currentIndex, desired.data + desiredIndex, length) == 0);
+  }
+
+  static unsigned long parameterValue(const Parameter& parameter) {
+    unsigned long value = 0;
+    for (unsigned short index = 0; index < parameter.length; index++) {
+      value = (value << 8) | parameter.data[index];
+    }
+
+    return value;
+  }
+
+  static long elapsed(const struct timespec& start) {
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+    return (1000 * (long)(current.tv_sec - start.tv_sec)) + ((current.tv_nsec - start.tv_nsec) / 1000000);
+  }
+
+  // ND response: MY, SH/SL, NI (null terminated), ...
+  static Module* parseModule(const Parameter& parameter) {
+    if (parameter.length <= (int)(sizeof(Address16) + sizeof(Address64))) {
+      return NULL;
+    }
+
+    Module* module = new Module();
+    module->address16 = Address16(parameter.data);
+    module->address64 = Address64(parameter.data + sizeof(module->address16));
+    const char* identifier = reinterpret_cast<const char*>(parameter.data + sizeof(module->address16) + sizeof(module->address64));
+    module->identifier = std::string(identifier, strnlen(identifier, parameter.length - sizeof(module->address16) - sizeof(module->address64)));
+
+    return module;
+  }
+
+  // frame ids wrap, so a response under the id of a request may still answer an earlier one
+  static bool matchesRequest(const RemoteCommandResponseFrame* response, Address64 address64, Command command) {
+    if ((address64 != BROADCAST) && (response->getAddress64() != address64)) {
+      return false;
+    }
+
+    return response->getCommand() == command;
+  }
+
+  class ModuleCollector : public ModuleDiscoveryListener {
+  public:
+    ModuleCollector(std::vector<Module*>& modules, std::size_t expectedCount) : modules_(modules) {
+      expectedCount_ = expectedCount;
+    }
+
+    ModuleCollector(std::vector<Module*>& modules, const std::set<Address64>& expectedAddresses) : modules_(modules), expectedAddresses_(expectedAddresses) {
+      expectedCount_ = 0;
+    }
+
+    bool discovered(Module* module) {
+      modules_.push_back(module);
+      if (!expectedAddresses_.empty()) {
+	expectedAddresses_.erase(module->address64);
+	return !expectedAddresses_.empty();
+      }
+
+      return (expectedCount_ == 0) || (modules_.size() < expectedCount_);
+    }
+
+  private:
+    std::vector<Module*>& modules_;
+    std::size_t expectedCount_;
+    std::set<Address64> expectedAddresses_;
+  };
+
+  // ends a response wait when its time is up
+  class ResponseDeadline : public Timer {
+  public:
+    ResponseDeadline(MessageRouter<byte, CommandResponseFrame*>* router, byte id) {
+      router_ = router;
+      id_ = id;
+    }
+
+  protected:
+    void expired() {
+      router_->expire(id_);
+    }
+
+  private:
+    MessageRouter<byte, CommandResponseFrame*>* router_;
+    byte id_;
+  };
+
+  // how often a configured module is expected to report, in ms: its IO sampling rate (IR),
+  // or its sleep period (SP, in 10 ms) when it only samples on waking; 0 when it does neither
+  long ModuleConfiguration::reportingInterval() const {
+    long interval = 0;
+    for (std::vector<CommandParameter*>::const_iterator it = commandParameters.begin(); it != commandParameters.end(); it++) {
+      long value = 0;
+      if ((*it)->command == Command("IR")) {
+	value = parameterValue((*it)->parameter);
+      }
+      else if ((*it)->command == Command("SP")) {
+	value = 10 * parameterValue((*it)->parameter);
+      }
+
+      if (value > interval) {
+	interval = value;
+      }
+    }
+
+    return interval;
+  }
+
   Manager::Manager() {
     idSequence_ = 0;
+    transmitWindow_ = DEFAULT_TRANSMIT_WINDOW;
+    deferredCount_ = 0;
+    discoveryListener_ = NULL;
+  }
+  
+  Manager::~Manager() {
+  }
+
+  int Manager::initialize(const char* device, int baud, FlowControl flowControl) {
+    int result = serial_.open(device, baud, flowControl);
+    if (result != 0) {
+      return result;
+    }
+
+    result = writer_.initialize(&serial_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = commandResponseRouter_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = timerWheel_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = liveness_.initialize(&timerWheel_, this);
+    if (result != 0) {
+      return result;
+    }
+
+    result = rules_.initialize(this);
+    if (result != 0) {
+      return result;
+    }
+
+    result = ioSampleQueue_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = moduleEventQueue_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = receivePacketQueue_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = transmitStatusQueue_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = registry_.initialize();
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_init(&addressCacheMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_init(&routeCacheMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_init(&transmitMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_cond_init(&transmitCond_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_init(&deferredMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_init(&rttMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = addFrameHandlers();
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_create(&monitorThread_, NULL, &Manager::monitor_, this);
+    if (result != 0) {
+      return result;
+    }
+
+    return 0;
+  }
+
+  int Manager::destroy() {
+    if (discoveryListener_ != NULL) {
+      pthread_join(discoveryThread_, NULL);
+      discoveryListener_ = NULL;
+    }
+
+    int result = pthread_cancel(monitorThread_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_join(monitorThread_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = removeFrameHandlers();
+    if (result != 0) {
+      return result;
+    }
+
+    result = commandResponseRouter_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = liveness_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = rules_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = timerWheel_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = ioSampleQueue_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = moduleEventQueue_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = receivePacketQueue_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = transmitStatusQueue_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = registry_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_destroy(&addressCacheMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_destroy(&routeCacheMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_cond_destroy(&transmitCond_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_destroy(&transmitMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_destroy(&deferredMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_destroy(&rttMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = writer_.destroy();
+    if (result != 0) {
+      return result;
+    }
+
+    return serial_.close();
+  }
+
+  int Manager::discoverModules(std::vector<Module*>& modules, std::size_t expectedCount) {
+    ModuleCollector collector(modules, expectedCount);
+    return discoverModules(&collector);
+  }
+
+  int Manager::discoverModules(std::vector<Module*>& modules, const std::set<Address64>& expectedAddresses) {
+    ModuleCollector collector(modules, expectedAddresses);
+    return discoverModules(&collector);
+  }
+
+  int Manager::discoverModules(ModuleDiscoveryListener* listener) {
+    Parameter parameter;
+    int result = getParameter(Command("NT"), &parameter);
+    if (result != 0) {
+      listener->completed(result);
+      return result;
+    }
+
+    byte id = getNextId();
+    commandResponseRouter_.expect(id);
+    result = writer_.send(CommandFrame(Command("ND"), id));
+    if (result != 0) {
+      commandResponseRouter_.discard(id);
+      listener->completed(result);
+      return result;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long timeout = (long)parameter.ushort() * 100 * 12 / 10;  // + 20%
+
+    long timeRemaining = timeout;
+    while (timeRemaining > 0) {
+      CommandResponseFrame* response = waitForCommandResponse(id, (unsigned short)std::min(timeRemaining, 0xFFFFl), false);
+      if (response != NULL) {
+	Module* module = parseModule(response->getParameter());
+	delete response;
+	if (module == NULL) {
+	  continue;
+	}
+
+	// the configuration applied to a known module survives rediscovery
+	Module known;
+	if (registry_.find(module->address64, &known)) {
+	  module->fingerprint = known.fingerprint;
+	}
+	registry_.update(*module);
+
+	if (!listener->discovered(module)) {
+	  break;
+	}
+      }
+
+      timeRemaining = timeout - elapsed(start);
+    }
+
+    commandResponseRouter_.discard(id);
+    listener->completed(0);
+    return 0;
+  }
+
+  int Manager::discoverModulesAsync(ModuleDiscoveryListener* listener) {
+    if (discoveryListener_ != NULL) {
+      int result = pthread_join(discoveryThread_, NULL);
+      if (result != 0) {
+	return result;
+      }
+    }
+
+    discoveryListener_ = listener;
+    int result = pthread_create(&discoveryThread_, NULL, &Manager::discover_, this);
+    if (result != 0) {
+      discoveryListener_ = NULL;
+    }
+
+    return result;
+  }
+
+  int Manager::loadRegistry(const char* path) {
+    return registry_.load(path);
+  }
+
+  int Manager::saveRegistry(const char* path) {
+    return registry_.save(path);
+  }
+
+  int Manager::getRegisteredModules(std::vector<Module*>& modules) {
+    return registry_.getModules(modules);
+  }
+
+  bool Manager::findModule(Address64 address64, Module* module) {
+    return registry_.find(address64, module);
+  }
+
+  int Manager::configureModule(Module* module, ModuleConfiguration* configuration) {
+    long interval = configuration->reportingInterval();
+    if (interval > 0) {
+      setExpectedInterval(module, interval);
+    }
+
+    unsigned long fingerprint = configuration->fingerprint();
+    if (module->fingerprint == fingerprint) {
+      return 0;
+    }
+
+    std::string identifier = configuration->identifier;
+    if (identifier.empty()) {
+      std::ostringstream nodeIdentifier;
+      nodeIdentifier << "Node " << std::hex << std::uppercase << (int)module->address16.a << "-" << (int)module->address16.b;
+      identifier = nodeIdentifier.str();
+    }
+
+    std::vector<CommandParameter*>& commandParameters = configuration->commandParameters;
+
+    // read current values, pipelined: all queries go out before the first response is awaited
+    std::vector<byte> ids;
+    ids.push_back(sendRemoteCommand(module, Command("NI"), Parameter(), 0, PRIORITY_BULK));
+    for (std::vector<CommandParameter*>::iterator it = commandParameters.begin(); it != commandParameters.end(); it++) {
+      ids.push_back(sendRemoteCommand(module, (*it)->command, Parameter(), 0, PRIORITY_BULK));
+    }
+
+    std::vector<bool> changed;
+    for (std::vector<byte>::iterator it = ids.begin(); it != ids.end(); it++) {
+      RemoteCommandResponseFrame* response = waitForRemoteCommandResponse(*it, getRemoteTimeout(module->address64));
+      bool differs = true;
+      if ((response != NULL) && (response->getStatus() == STATUS_OK)) {
+	if (changed.empty()) {
+	  differs = (response->getParameter().std_string().compare(identifier) != 0);
+	}
+	else {
+	  differs = !parameterEquals(response->getParameter(), commandParameters[changed.size() - 1]->parameter);
+	}
+      }
+      changed.push_back(differs);
+
+      if (response != NULL) {
+	delete response;
+      }
+    }
+
+    // write only what differs, again pipelined
+    ids.clear();
+    if (changed[0]) {
+      ids.push_back(sendRemoteCommand(module, Command("NI"), Parameter(identifier.c_str()), 0, PRIORITY_BULK));
+    }
+    for (std::size_t index = 0; index < commandParameters.size(); index++) {
+      if (changed[index + 1]) {
+	ids.push_back(sendRemoteCommand(module, commandParameters[index]->command, commandParameters[index]->parameter, 0, PRIORITY_BULK));
+      }
+    }
+
+    int result = 0;
+    for (std::vector<byte>::iterator it = ids.begin(); it != ids.end(); it++) {
+      RemoteCommandResponseFrame* response = waitForRemoteCommandResponse(*it, getRemoteTimeout(module->address64));
+      if (response == NULL) {
+	result = -1;
+	continue;
+      }
+
+      if ((response->getStatus() != STATUS_OK) && (result == 0)) {
+	result = response->getStatus();
+      }
+      delete response;
+    }
+
+    if ((result == 0) && !ids.empty()) {
+      RemoteCommandResponseFrame* response = waitForRemoteCommandResponse(sendRemoteCommand(module, Command("AC"), Parameter(), 0, PRIORITY_BULK), getRemoteTimeout(module->address64));
+      if (response == NULL) {
+	result = -1;
+      }
+      else {
+	delete response;
+      }
+    }
+
+    module->identifier = identifier;
+    if (result == 0) {
+      module->fingerprint = fingerprint;
+    }
+    registry_.update(*module);
+
+    return result;
+  }
+
+  // a module tracked this way goes MODULE_STALE after STALE_INTERVALS intervals without a frame
+  int Manager::setExpectedInterval(Module* module, long interval) {
+    return liveness_.track(module->address64, interval);
+  }
+
+  bool Manager::isModuleStale(Module* module) {
+    return liveness_.isStale(module->address64);
+  }
+
+  // the rule is evaluated on the monitor thread as each sample from condition.source is read
+  int Manager::addRule(const RuleCondition& condition, const RuleAction& action) {
+    return rules_.add(condition, action);
+  }
+
+  int Manager::removeRule(int id) {
+    return rules_.remove(id);
+  }
+
+  // frames of a type the library does not model, or one nothing here consumes, go to handler
+  // on the monitor thread; it must not block. The types the manager handles itself are refused
+  int Manager::registerFrameType(byte type, FrameDecoder decoder, FrameHandler handler, void* context) {
+    return serial_.getDispatcher()->add(type, decoder, handler, context);
+  }
+
+  int Manager::unregisterFrameType(byte type, FrameHandler handler) {
+    return serial_.getDispatcher()->remove(type, handler);
+  }
+
+  // bytes left waiting in the serial driver before the writer holds back, 0 for no pacing
+  void Manager::setPacingWindow(std::size_t window) {
+    writer_.setPacingWindow(window);
+  }
+
+  int Manager::getSendStatistics(Priority priority, LaneStatistics* statistics) {
+    return writer_.getStatistics(priority, statistics);
+  }
+
+  int Manager::setModuleIdentifier(Module* module, const char* identifier) {
+    return setRemoteParameter(module, Command("NI"), Parameter(identifier), OPTION_APPLY);
+  }
+
+  int Manager::subscribeIOSample(IOSampleFrameSubscriber* subscriber) {
+    return ioSampleQueue_.subscribe(subscriber);
+  }
+
+  int Manager::unsubscribeIOSample(IOSampleFrameSubscriber* subscriber) {
+    return ioSampleQueue_.unsubscribe(subscriber);
+  }
+
+  int Manager::subscribeModuleEvent(ModuleEventSubscriber* subscriber) {
+    return moduleEventQueue_.subscribe(subscriber);
+  }
+
+  int Manager::unsubscribeModuleEvent(ModuleEventSubscriber* subscriber) {
+    return moduleEventQueue_.unsubscribe(subscriber);
+  }
+
+  int Manager::subscribeReceivePacket(ReceivePacketFrameSubscriber* subscriber) {
+    return receivePacketQueue_.subscribe(subscriber);
+  }
+
+  int Manager::unsubscribeReceivePacket(ReceivePacketFrameSubscriber* subscriber) {
+    return receivePacketQueue_.unsubscribe(subscriber);
+  }
+
+  int Manager::subscribeTransmitStatus(TransmitStatusFrameSubscriber* subscriber) {
+    return transmitStatusQueue_.subscribe(subscriber);
+  }
+
+  int Manager::unsubscribeTransmitStatus(TransmitStatusFrameSubscriber* subscriber) {
+    return transmitStatusQueue_.unsubscribe(subscriber);
+  }
+
+  byte Manager::transmit(Module* module, DataView data, byte options) {
+    Address16 address16 = resolveAddress16(module);
+    sendSourceRoute(module->address64, address16, PRIORITY_BULK);
+
+    byte id = acquireTransmitSlot(module->address64);
+    if (id == 0) {
+      return 0;
+    }
+
+    int result = writer_.send(TransmitRequestFrame(module->address64, address16, data, id, options), PRIORITY_BULK);
+    if (result != 0) {
+      releaseTransmitSlot(id);
+      return 0;
+    }
+
+    return id;
+  }
+
+  byte Manager::transmit(Module* module, ExplicitAddressing addressing, DataView data, byte options) {
+    Address16 address16 = resolveAddress16(module);
+    sendSourceRoute(module->address64, address16, PRIORITY_BULK);
+
+    byte id = acquireTransmitSlot(module->address64);
+    if (id == 0) {
+      return 0;
+    }
+
+    int result = writer_.send(ExplicitTransmitFrame(module->address64, address16, addressing, data, id, options), PRIORITY_BULK);
+    if (result != 0) {
+      releaseTransmitSlot(id);
+      return 0;
+    }
+
+    return id;
+  }
+
+  void Manager::setTransmitWindow(std::size_t window) {
+    if (pthread_mutex_lock(&transmitMutex_) == 0) {
+      transmitWindow_ = (window > 0) ? window : 1;
+      pthread_cond_broadcast(&transmitCond_);
+      pthread_mutex_unlock(&transmitMutex_);
+    }
+  }
+
+  CommandResponseFrame* Manager::sendCommandForResponse(Command command, Parameter parameter) {
+    return sendCommandForResponse(CommandFrame(command, parameter, getNextId()));
+  }
+  
+  RemoteCommandResponseFrame* Manager::sendRemoteCommandForResponse(Module* module, Command command, Parameter parameter, byte options) {
+    RemoteCommandTemplate remoteCommand(module->address64, module->address16, options, command);
+    return sendRemoteCommandForResponse(&remoteCommand, parameter);
+  }
+
+  RemoteCommandResponseFrame* Manager::sendRemoteCommandForResponse(RemoteCommandTemplate* command, Parameter parameter) {
+    Address64 address64 = command->getAddress64();
+
+    // each attempt waits the module's current retransmission timeout
+    for (int attempt = 0; attempt <= REMOTE_COMMAND_RETRIES; attempt++) {
+      struct timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+
+      byte id = getNextId();
+      commandResponseRouter_.expect(id);
+      if (sendTemplate(command, parameter, id, PRIORITY_INTERACTIVE) != 0) {
+	commandResponseRouter_.discard(id);
+	return NULL;
+      }
+
+      // a response left over from an earlier user of the id is not the answer
+      unsigned short timeout = getRemoteTimeout(address64);
+      RemoteCommandResponseFrame* remoteResponse = NULL;
+      long timeRemaining = timeout;
+      while ((remoteResponse == NULL) && (timeRemaining > 0)) {
+	remoteResponse = waitForRemoteCommandResponse(id, (unsigned short)timeRemaining, false);
+	if ((remoteResponse != NULL) && !matchesRequest(remoteResponse, address64, command->getCommand())) {
+	  delete remoteResponse;
+	  remoteResponse = NULL;
+	}
+
+	timeRemaining = timeout - elapsed(start);
+      }
+      commandResponseRouter_.discard(id);
+
+      if (remoteResponse != NULL) {
+	if (attempt == 0) {
+	  measured(address64, elapsed(start));
+	}
+	return remoteResponse;
+      }
+
+      timedOut(address64);
+    }
+
+    return NULL;
+  }
+
+  // for control loops: no frame id, so the radio sends no response and nothing waits for one
+  int Manager::sendRemoteCommand(RemoteCommandTemplate* command, Parameter parameter, Priority priority) {
+    return sendTemplate(command, parameter, 0, priority);
+  }
+  
+  int Manager::getParameter(Command command, Parameter* parameter) {
+    CommandResponseFrame* response = sendCommandForResponse(command);
+    if (response == NULL) {
+      return -1;
+    }
+
+    *parameter = response->detachParameter();
+    byte status = response->getStatus();
+
+    delete response;
+    return status;
+  }
+  
+  int Manager::getRemoteParameter(Module* module, Command command, Parameter* parameter) {
+    RemoteCommandResponseFrame* response = sendRemoteCommandForResponse(module, command);
+    if (response == NULL) {
+      return -1;
+    }
+
+    *parameter = response->detachParameter();
+    byte status = response->getStatus();
+
+    delete response;
+    return status;
+  }
+  
+  int Manager::setParameter(Command command, Parameter parameter) {
+    CommandResponseFrame* response = sendCommandForResponse(command, parameter);
+    if (response == NULL) {
+      return -1;
+    }
+
+    byte status = response->getStatus();
+
+    delete response;
+    return status;
+  }
+  
+  int Manager::setParameters(const std::vector<CommandParameter*>& commandParameters) {
+    if (commandParameters.empty()) {
+      return 0;
+    }
+
+    // queue every value, then apply them all in a single cycle
+    std::vector<byte> ids;
+    for (std::vector<CommandParameter*>::const_iterator it = commandParameters.begin(); it != commandParameters.end(); it++) {
+      byte id = getNextId();
+      commandResponseRouter_.expect(id);
+      if (writer_.send(QueuedCommandFrame((*it)->command, (*it)->parameter, id), PRIORITY_BULK) == 0) {
+	ids.push_back(id);
+      }
+      else {
+	commandResponseRouter_.discard(id);
+	ids.push_back(0);
+      }
+    }
+
+    int result = 0;
+    for (std::vector<byte>::iterator it = ids.begin(); it != ids.end(); it++) {
+      CommandResponseFrame* response = waitForCommandResponse(*it);
+      if (response == NULL) {
+	result = -1;
+	continue;
+      }
+
+      if ((response->getStatus() != STATUS_OK) && (result == 0)) {
+	result = response->getStatus();
+      }
+      delete response;
+    }
+
+    // a rejected value must not be applied along with the others
+    if (result != 0) {
+      return result;
+    }
+
+    CommandResponseFrame* response = sendCommandForResponse(CommandFrame(Command("AC"), getNextId()));
+    if (response == NULL) {
+      return -1;
+    }
+
+    result = response->getStatus();
+
+    delete response;
+    return result;
+  }
+  
+  int Manager::setRemoteParameter(Module* module, Command command, Parameter parameter, byte options) {
+    RemoteCommandResponseFrame* response = sendRemoteCommandForResponse(module, command, parameter, options);
+    if (response == NULL) {
+      return -1;
+    }
+
+    byte status = response->getStatus();
+
+    delete response;
+    return status;
   }
   
-  Manager::~Manager() {
+
+  int Manager::broadcastRemoteCommand(Command command, unsigned short window, RemoteCommandResponseFrameSubscriber* subscriber, Parameter parameter, byte options) {
+    return gatherRemoteCommandResponses(command, parameter, options, window, subscriber, NULL);
   }
 
-  int Manager::initialize() {
-    int result = serial_.open("/dev/ttyUSB0", 9600);
-    if (result != 0) {
-      return result;
-    }
+  int Manager::broadcastRemoteCommand(Command command, unsigned short window, std::map<Address64, RemoteCommandResponseFrame*>& responses, Parameter parameter, byte options) {
+    return gatherRemoteCommandResponses(command, parameter, options, window, NULL, &responses);
+  }
+  
 
-    result = commandResponseRouter_.initialize();
-    if (result != 0) {
-      return result;
-    }
+  // held until the module is next heard from, typically its IO sample on waking
+  int Manager::deferRemoteParameter(Module* module, Command command, Parameter parameter, byte options) {
+    DeferredCommand deferred;
+    deferred.command = command;
+    deferred.parameter.assign(parameter.data, parameter.data + parameter.length);
+    deferred.options = options;
 
-    result = ioSampleQueue_.initialize();
+    int result = pthread_mutex_lock(&deferredMutex_);
     if (result != 0) {
       return result;
     }
 
-    result = pthread_create(&monitorThread_, NULL, &Manager::monitor_, this);
-    if (result != 0) {
-      return result;
+    deferredCommands_[module->address64].push_back(deferred);
+    __sync_add_and_fetch(&deferredCount_, 1);
+
+    return pthread_mutex_unlock(&deferredMutex_);
+  }
+  
+
+  unsigned short Manager::getRemoteTimeout(Address64 address64) {
+    unsigned short timeout = INITIAL_TIMEOUT;
+    if (pthread_mutex_lock(&rttMutex_) == 0) {
+      RttEstimator* estimator = rttEstimators_.find(address64);
+      if (estimator != NULL) {
+	timeout = estimator->getTimeout();
+      }
+      pthread_mutex_unlock(&rttMutex_);
     }
 
-    return 0;
+    return timeout;
   }
+  
 
-  int Manager::destroy() {
-    int result = pthread_cancel(monitorThread_);
-    if (result != 0) {
-      return result;
+  byte Manager::getNextId() {
+    // shared by every caller thread; 0 means no response is wanted, so skip it
+    byte id;
+    while ((id = __sync_add_and_fetch(&idSequence_, 1)) == 0) {
     }
+    return id;
+  }
 
-    result = pthread_join(monitorThread_, NULL);
-    if (result != 0) {
-      return result;
+  // id must have been expected before its command was sent. Unless last is false (several
+  // responses share the id), the id is discarded afterwards so a late response is dropped
+  CommandResponseFrame* Manager::waitForCommandResponse(byte id, unsigned short timeout, bool last) {
+    if (id == 0) {
+      return NULL;
     }
 
-    result = commandResponseRouter_.destroy();
-    if (result != 0) {
-      return result;
+    // the deadline lives on the monitor's timer wheel; the timed wait behind it only ends
+    // the wait should the monitor thread be held up in a subscriber or a rule
+    ResponseDeadline deadline(&commandResponseRouter_, id);
+    timerWheel_.arm(&deadline, timeout);
+
+    long fallback = (long)timeout + DEADLINE_FALLBACK;
+    CommandResponseFrame* response = commandResponseRouter_.waitForMessage(id, (unsigned short)std::min(fallback, 0xFFFFl));
+    timerWheel_.cancel(&deadline);
+
+    if (last) {
+      commandResponseRouter_.discard(id);
     }
 
-    result = ioSampleQueue_.destroy();
+    return response;
+  }
+
+  byte Manager::sendRemoteCommand(Module* module, Command command, Parameter parameter, byte options, Priority priority) {
+    RemoteCommandTemplate remoteCommand(module->address64, module->address16, options, command);
+
+    byte id = getNextId();
+    commandResponseRouter_.expect(id);
+    int result = sendTemplate(&remoteCommand, parameter, id, priority);
     if (result != 0) {
-      return result;
+      commandResponseRouter_.discard(id);
+      return 0;
     }
 
-    return serial_.close();
+    return id;
   }
 
-  int Manager::discoverModules(std::vector<Module*>& modules) {
-    Parameter parameter;
-    int result = getParameter(Command("NT"), &parameter);
-    if (result != 0) {
-      return result;
+  // a template is used by one thread at a time. It follows the module's 16-bit address, and
+  // goes back to UNKNOWN once the address is invalidated rather than keeping its own
+  int Manager::sendTemplate(RemoteCommandTemplate* command, const Parameter& parameter, byte id, Priority priority) {
+    command->setAddress16(resolveAddress16(command->getAddress64(), command->getAddress16()));
+    sendSourceRoute(command->getAddress64(), command->getAddress16(), priority);
+
+    Buffer encoded;
+    command->encode(id, parameter, &encoded);
+
+    return writer_.send(&encoded, priority);
+  }
+
+  RemoteCommandResponseFrame* Manager::waitForRemoteCommandResponse(byte id, unsigned short timeout, bool last) {
+    CommandResponseFrame* response = waitForCommandResponse(id, timeout, last);
+    RemoteCommandResponseFrame *remoteResponse = dynamic_cast<RemoteCommandResponseFrame*>(response);
+    if ((remoteResponse == NULL) && (response != NULL)) {
+      delete response;
     }
 
+    return remoteResponse;
+  }
+
+  int Manager::gatherRemoteCommandResponses(Command command, Parameter parameter, byte options, unsigned short window, RemoteCommandResponseFrameSubscriber* subscriber, std::map<Address64, RemoteCommandResponseFrame*>* responses) {
     byte id = getNextId();
-    result = serial_.send(CommandFrame(Command("ND"), id));
+    commandResponseRouter_.expect(id);
+    int result = writer_.send(RemoteCommandFrame(BROADCAST, UNKNOWN, options, command, parameter, id));
     if (result != 0) {
+      commandResponseRouter_.discard(id);
       return result;
     }
 
     struct timespec start;
     clock_gettime(CLOCK_MONOTONIC, &start);
 
-    short timeRemaining = (short)(parameter.ushort() * 100 * 1.2);  // + 20%
+    // every module answers with the same frame id until the window closes
+    long timeRemaining = window;
     while (timeRemaining > 0) {
-      CommandResponseFrame* response = commandResponseRouter_.waitForMessage(id, timeRemaining);
+      RemoteCommandResponseFrame* response = waitForRemoteCommandResponse(id, (unsigned short)timeRemaining, false);
       if (response != NULL) {
-	byte* data = response->getParameter().data;
-	int length = response->getParameter().length;
+	if (responses != NULL) {
+	  std::map<Address64, RemoteCommandResponseFrame*>::iterator it = responses->find(response->getAddress64());
+	  if (it != responses->end()) {
+	    delete it->second;
+	  }
+	  (*responses)[response->getAddress64()] = response;
+	}
+	else {
+	  subscriber->received(response);
+	  delete response;
+	}
+      }
 
-	if (length > (int)(sizeof(Address16) + sizeof(Address64))) {
-	  Module* module = new Module();
-	  module->address16 = Address16(data);
-	  module->address64 = Address64(data + sizeof(module->address16));
-	  module->identifier = std::string(reinterpret_cast<const char*>(data + sizeof(module->address16) + sizeof(module->address64)));
+      timeRemaining = window - elapsed(start);
+    }
 
-	  modules.push_back(module);
-	}
+    return commandResponseRouter_.discard(id);
+  }
 
-	delete response;
-      }
-     
-      struct timespec current;
-      clock_gettime(CLOCK_MONOTONIC, &current);
-      unsigned long long diff = (1000000000 * (current.tv_sec - start.tv_sec) + current.tv_nsec - start.tv_nsec) / 1000000;
-      timeRemaining -= diff;
+  // the last 16-bit address heard from a module spares the radio a network address discovery
+  Address16 Manager::resolveAddress16(const Module* module) {
+    return resolveAddress16(module->address64, module->address16);
+  }
+
+  Address16 Manager::resolveAddress16(Address64 address64, Address16 address16) {
+    if (pthread_mutex_lock(&addressCacheMutex_) != 0) {
+      return address16;
     }
-    
-    return 0;
+
+    Address16* cached = addressCache_.find(address64);
+    if (cached != NULL) {
+      address16 = *cached;
+    }
+
+    pthread_mutex_unlock(&addressCacheMutex_);
+
+    return address16;
   }
 
-  int Manager::configureModule(Module* module, ModuleConfiguration* configuration) {
-    module->identifier = configuration->identifier;
-    if (module->identifier.empty()) {
-      std::ostringstream identifier;
-      identifier << "Node " << std::hex << std::uppercase << (int)module->address16.a << "-" << (int)module->address16.b;
-      module->identifier = identifier.str();
+  void Manager::received(Address64 address64, Address16 address16) {
+    if ((address16 != UNKNOWN) && (pthread_mutex_lock(&addressCacheMutex_) == 0)) {
+      addressCache_[address64] = address16;
+      pthread_mutex_unlock(&addressCacheMutex_);
+    }
+
+    registry_.touch(address64, address16);
+    liveness_.seen(address64);
+
+    if (__sync_fetch_and_add(&deferredCount_, 0) > 0) {
+      flushDeferred(address64, address16);
+    }
+  }
+
+  // cached as UNKNOWN rather than dropped, or the caller's own stale address would be used again
+  void Manager::invalidateAddress16(Address64 address64) {
+    if (pthread_mutex_lock(&addressCacheMutex_) == 0) {
+      addressCache_[address64] = UNKNOWN;
+      pthread_mutex_unlock(&addressCacheMutex_);
+    }
+
+    // a failed delivery may as well be a broken route
+    if (pthread_mutex_lock(&routeCacheMutex_) == 0) {
+      routeCache_.erase(address64);
+      pthread_mutex_unlock(&routeCacheMutex_);
+    }
+  }
+
+  void Manager::recordRoute(const RouteRecordFrame* routeRecord) {
+    received(routeRecord->getAddress64(), routeRecord->getAddress16());
+
+    if (pthread_mutex_lock(&routeCacheMutex_) == 0) {
+      routeCache_[routeRecord->getAddress64()] = routeRecord->getRoute();
+      pthread_mutex_unlock(&routeCacheMutex_);
+    }
+  }
+
+  // goes in the same lane as the frame it routes, so the two stay in order
+  int Manager::sendSourceRoute(Address64 address64, Address16 address16, Priority priority) {
+    if (address16 == UNKNOWN) {
+      return 0;
     }
 
-    int result = setModuleIdentifier(module, module->identifier.c_str());
+    Route route;
+    int result = pthread_mutex_lock(&routeCacheMutex_);
     if (result != 0) {
       return result;
     }
 
-    for (std::vector<CommandParameter*>::iterator it = configuration->commandParameters.begin(); it != configuration->commandParameters.end(); it++) {
-      result = setRemoteParameter(module, (*it)->command, (*it)->parameter);
-      if (result != 0) {
-	return result;
-      }
+    Route* cached = routeCache_.find(address64);
+    if (cached != NULL) {
+      route = *cached;
     }
 
-    if (!configuration->commandParameters.empty()) {
-      CommandResponseFrame* response = sendRemoteCommandForResponse(module, Command("AC"));
-      if (response == NULL) {
-	result = -1;
-      }
+    pthread_mutex_unlock(&routeCacheMutex_);
+
+    // neighbours (no hops) and unknown routes are left to the radio
+    if (route.empty()) {
+      return 0;
     }
 
-    return result;
+    return writer_.send(CreateSourceRouteFrame(address64, address16, route), priority);
   }
 
-  int Manager::setModuleIdentifier(Module* module, const char* identifier) {
-    return setRemoteParameter(module, Command("NI"), Parameter(identifier), OPTION_APPLY);
+  void Manager::identified(const NodeIdentificationFrame* nodeIdentification) {
+    Module module = nodeIdentification->getModule();
+    received(module.address64, module.address16);
+
+    Module known;
+    ModuleEventType type = MODULE_JOINED;
+    if (registry_.find(module.address64, &known)) {
+      module.fingerprint = known.fingerprint;
+      type = MODULE_REJOINED;
+    }
+    registry_.update(module);
+
+    moduleEventQueue_.publish(ModuleEvent(type, module));
   }
 
-  int Manager::subscribeIOSample(IOSampleFrameSubscriber* subscriber) {
-    return ioSampleQueue_.subscribe(subscriber);
+  // runs on the monitor thread, from the timer wheel
+  void Manager::stale(Address64 address64) {
+    Module module;
+    if (!registry_.find(address64, &module)) {
+      module = Module(address64, UNKNOWN, "");
+    }
+
+    moduleEventQueue_.publish(ModuleEvent(MODULE_STALE, module));
   }
 
-  int Manager::unsubscribeIOSample(IOSampleFrameSubscriber* subscriber) {
-    return ioSampleQueue_.unsubscribe(subscriber);
+  void Manager::back(Address64 address64) {
+    Module module;
+    if (!registry_.find(address64, &module)) {
+      module = Module(address64, UNKNOWN, "");
+    }
+
+    moduleEventQueue_.publish(ModuleEvent(MODULE_BACK, module));
   }
 
-  CommandResponseFrame* Manager::sendCommandForResponse(Command command, Parameter parameter) {
-    return sendCommandForResponse(CommandFrame(command, parameter, getNextId()));
+  // fire and forget: frame id 0 asks for no response, so nothing waits on the monitor thread
+  void Manager::actuate(RuleAction& action) {
+    sendTemplate(&action.command, action.parameter, 0, PRIORITY_URGENT);
   }
-  
-  RemoteCommandResponseFrame* Manager::sendRemoteCommandForResponse(Module* module, Command command, Parameter parameter, byte options) {
-    CommandResponseFrame* response = sendCommandForResponse(RemoteCommandFrame(module->address64, module->address16, options, command, parameter, getNextId()));
-    RemoteCommandResponseFrame *remoteResponse = dynamic_cast<RemoteCommandResponseFrame*>(response);
-    if ((remoteResponse == NULL) && (response != NULL)) {
-      delete response;
+
+  // keeps at most transmitWindow_ frames between the radio's buffer and their transmit status
+  byte Manager::acquireTransmitSlot(Address64 address64) {
+    if (pthread_mutex_lock(&transmitMutex_) != 0) {
+      return 0;
     }
 
-    return remoteResponse;
-  }
-  
-  int Manager::getParameter(Command command, Parameter* parameter) {
-    CommandResponseFrame* response = sendCommandForResponse(command);
-    if (response == NULL) {
-      return -1;
+    while (pendingTransmits_.size() >= transmitWindow_) {
+      for (std::map<byte, PendingTransmit>::iterator it = pendingTransmits_.begin(); it != pendingTransmits_.end();) {
+	if (elapsed(it->second.sent) > TRANSMIT_STATUS_TIMEOUT) {
+	  pendingTransmits_.erase(it++);
+	}
+	else {
+	  it++;
+	}
+      }
+
+      if (pendingTransmits_.size() < transmitWindow_) {
+	break;
+      }
+
+      timeval now;
+      gettimeofday(&now, NULL);
+      timespec ts;
+      ts.tv_sec = now.tv_sec + 1;
+      ts.tv_nsec = now.tv_usec * 1000;
+      pthread_cond_timedwait(&transmitCond_, &transmitMutex_, &ts);
     }
 
-    *parameter = response->detachParameter();
-    byte status = response->getStatus();
+    byte id = getNextId();
+    PendingTransmit& pending = pendingTransmits_[id];
+    pending.address64 = address64;
+    clock_gettime(CLOCK_MONOTONIC, &pending.sent);
 
-    delete response;
-    return status;
+    pthread_mutex_unlock(&transmitMutex_);
+
+    return id;
   }
-  
-  int Manager::getRemoteParameter(Module* module, Command command, Parameter* parameter) {
-    RemoteCommandResponseFrame* response = sendRemoteCommandForResponse(module, command);
-    if (response == NULL) {
-      return -1;
+
+  void Manager::releaseTransmitSlot(byte id) {
+    if (pthread_mutex_lock(&transmitMutex_) == 0) {
+      pendingTransmits_.erase(id);
+      pthread_cond_signal(&transmitCond_);
+      pthread_mutex_unlock(&transmitMutex_);
     }
+  }
 
-    *parameter = response->detachParameter();
-    byte status = response->getStatus();
+  void Manager::transmitted(const TransmitStatusFrame* transmitStatus) {
+    if (pthread_mutex_lock(&transmitMutex_) != 0) {
+      return;
+    }
 
-    delete response;
-    return status;
-  }
-  
-  int Manager::setParameter(Command command, Parameter parameter) {
-    CommandResponseFrame* response = sendCommandForResponse(command, parameter);
-    if (response == NULL) {
-      return -1;
+    bool pending = false;
+    Address64 address64;
+    std::map<byte, PendingTransmit>::iterator it = pendingTransmits_.find(transmitStatus->getId());
+    if (it != pendingTransmits_.end()) {
+      pending = true;
+      address64 = it->second.address64;
+      pendingTransmits_.erase(it);
+      pthread_cond_signal(&transmitCond_);
     }
 
-    byte status = response->getStatus();
+    pthread_mutex_unlock(&transmitMutex_);
 
-    delete response;
-    return status;
+    if (pending) {
+      // a sleeping or slow module fails delivery too, only these say its address or route is gone
+      byte deliveryStatus = transmitStatus->getDeliveryStatus();
+      if (deliveryStatus == DELIVERY_SUCCESS) {
+	received(address64, transmitStatus->getAddress16());
+      }
+      else if ((deliveryStatus == DELIVERY_ADDRESS_NOT_FOUND) || (deliveryStatus == DELIVERY_ROUTE_NOT_FOUND)) {
+	invalidateAddress16(address64);
+      }
+    }
   }
-  
-  int Manager::setRemoteParameter(Module* module, Command command, Parameter parameter, byte options) {
-    RemoteCommandResponseFrame* response = sendRemoteCommandForResponse(module, command, parameter, options);
-    if (response == NULL) {
-      return -1;
+
+  // runs on the monitor thread: sends without waiting, responses come back through deferredResponse
+  void Manager::flushDeferred(Address64 address64, Address16 address16) {
+    if (pthread_mutex_lock(&deferredMutex_) != 0) {
+      return;
     }
 
-    byte status = response->getStatus();
+    // commands whose response never came are retried along with the rest
+    for (std::map<byte, PendingDeferred>::iterator it = deferredResponses_.begin(); it != deferredResponses_.end();) {
+      if (elapsed(it->second.sent) > RESPONSE_TIMEOUT) {
+	deferredCommands_[it->second.address64].push_back(it->second.command);
+	__sync_add_and_fetch(&deferredCount_, 1);
+	deferredResponses_.erase(it++);
+      }
+      else {
+	it++;
+      }
+    }
 
-    delete response;
-    return status;
+    std::deque<DeferredCommand> commands;
+    std::deque<DeferredCommand>* queued = deferredCommands_.find(address64);
+    if (queued != NULL) {
+      commands.swap(*queued);
+      deferredCommands_.erase(address64);
+      __sync_sub_and_fetch(&deferredCount_, (int)commands.size());
+    }
+
+    if (!commands.empty()) {
+      sendSourceRoute(address64, address16);
+    }
+
+    for (std::deque<DeferredCommand>::iterator it = commands.begin(); it != commands.end(); it++) {
+      byte id = getNextId();
+      PendingDeferred& pending = deferredResponses_[id];
+      pending.address64 = address64;
+      pending.command = *it;
+      clock_gettime(CLOCK_MONOTONIC, &pending.sent);
+
+      Parameter parameter;
+      if (!it->parameter.empty()) {
+	parameter = Parameter(&it->parameter[0], it->parameter.size());
+      }
+      if (writer_.send(RemoteCommandFrame(address64, address16, it->options, it->command, parameter, id)) != 0) {
+	deferredResponses_.erase(id);
+	deferredCommands_[address64].push_back(*it);
+	__sync_add_and_fetch(&deferredCount_, 1);
+      }
+    }
+
+    pthread_mutex_unlock(&deferredMutex_);
   }
-  
 
-  byte Manager::getNextId() {
-    return ++idSequence_;
+  void Manager::measured(Address64 address64, long rtt) {
+    if (pthread_mutex_lock(&rttMutex_) == 0) {
+      rttEstimators_[address64].sample(rtt);
+      pthread_mutex_unlock(&rttMutex_);
+    }
+  }
+
+  void Manager::timedOut(Address64 address64) {
+    if (pthread_mutex_lock(&rttMutex_) == 0) {
+      rttEstimators_[address64].backoff();
+      pthread_mutex_unlock(&rttMutex_);
+    }
+  }
+
+  bool Manager::deferredResponse(const RemoteCommandResponseFrame* remoteResponse) {
+    if (pthread_mutex_lock(&deferredMutex_) != 0) {
+      return false;
+    }
+
+    std::map<byte, PendingDeferred>::iterator it = deferredResponses_.find(remoteResponse->getId());
+    bool deferred = (it != deferredResponses_.end()) && (it->second.address64 == remoteResponse->getAddress64());
+    if (deferred) {
+      // asleep again before it could be delivered, so wait for the next wake
+      if (remoteResponse->getStatus() == STATUS_TX_FAILURE) {
+	deferredCommands_[it->second.address64].push_back(it->second.command);
+	__sync_add_and_fetch(&deferredCount_, 1);
+      }
+      else if (remoteResponse->getStatus() != STATUS_OK) {
+	logError(remoteResponse->getStatus(), "Deferred %s failed", it->second.command.command.std_string().c_str());
+      }
+      deferredResponses_.erase(it);
+    }
+
+    pthread_mutex_unlock(&deferredMutex_);
+
+    return deferred;
   }
 
   CommandResponseFrame* Manager::sendCommandForResponse(const CommandFrame& frame) {
@@ -229,40 +1249,145 @@ namespace XB {
       return NULL;
     }
     
-    int result = serial_.send(frame);
+    commandResponseRouter_.expect(frame.getId());
+    int result = writer_.send(frame);
     if (result != 0) {
+      commandResponseRouter_.discard(frame.getId());
       return NULL;
     }
 
-    return commandResponseRouter_.waitForMessage(frame.getId());
+    return waitForCommandResponse(frame.getId());
+  }
+
+  void* Manager::discover_(void* context) {
+    return ((Manager*)context)->discover();
+  }
+
+  void* Manager::discover() {
+    discoverModules(discoveryListener_);
+    return NULL;
   }
 
   void* Manager::monitor_(void *context) {
     return ((Manager*)context)->monitor();
   }
 
-  void* Manager::monitor() {
-    do {
-      Frame* response = serial_.receiveAny();
+  const Manager::FrameType Manager::FRAME_TYPES[] = {
+    { TYPE_COMMAND_RESPONSE, decodeFrame<CommandResponseFrame>, &Manager::commandResponse_ },
+    { TYPE_REMOTE_COMMAND_RESPONSE, decodeFrame<RemoteCommandResponseFrame>, &Manager::remoteCommandResponse_ },
+    { TYPE_IO_SAMPLE, decodeFrame<IOSampleFrame>, &Manager::ioSample_ },
+    { TYPE_NODE_IDENTIFICATION, decodeFrame<NodeIdentificationFrame>, &Manager::nodeIdentification_ },
+    { TYPE_RECEIVE_PACKET, decodeFrame<ReceivePacketFrame>, &Manager::receivePacket_ },
+    { TYPE_EXPLICIT_RECEIVE, decodeFrame<ExplicitReceiveFrame>, &Manager::receivePacket_ },
+    { TYPE_TRANSMIT_STATUS, decodeFrame<TransmitStatusFrame>, &Manager::transmitStatus_ },
+    { TYPE_ROUTE_RECORD, decodeFrame<RouteRecordFrame>, &Manager::routeRecord_ }
+  };
 
-      CommandResponseFrame* commandResponse = dynamic_cast<CommandResponseFrame*>(response);
-      if (commandResponse != NULL) {
-	commandResponseRouter_.route(commandResponse->getId(), commandResponse);
-	continue;
+  const std::size_t Manager::FRAME_TYPE_COUNT = sizeof(FRAME_TYPES) / sizeof(FRAME_TYPES[0]);
+
+  int Manager::addFrameHandlers() {
+    FrameDispatcher* dispatcher = serial_.getDispatcher();
+    for (std::size_t index = 0; index < FRAME_TYPE_COUNT; index++) {
+      int result = dispatcher->add(FRAME_TYPES[index].type, FRAME_TYPES[index].decoder, FRAME_TYPES[index].handler, this);
+      if (result != 0) {
+	return result;
       }
+    }
 
-      IOSampleFrame* ioSample = dynamic_cast<IOSampleFrame*>(response);
-      if (ioSample != NULL) {
-	ioSampleQueue_.publish(ioSample);
-	continue;
+    return 0;
+  }
+
+  int Manager::removeFrameHandlers() {
+    FrameDispatcher* dispatcher = serial_.getDispatcher();
+    for (std::size_t index = 0; index < FRAME_TYPE_COUNT; index++) {
+      int result = dispatcher->remove(FRAME_TYPES[index].type, FRAME_TYPES[index].handler);
+      if (result != 0) {
+	return result;
       }
-      
-      if (response != NULL) {
-	delete response;
+    }
+
+    return 0;
+  }
+
+  // each handler is registered with the decoder of its frame class, so the casts are safe
+  void Manager::commandResponse_(Frame* frame, void* context) {
+    ((Manager*)context)->commandResponse(static_cast<CommandResponseFrame*>(frame));
+  }
+
+  void Manager::remoteCommandResponse_(Frame* frame, void* context) {
+    ((Manager*)context)->remoteCommandResponse(static_cast<RemoteCommandResponseFrame*>(frame));
+  }
+
+  void Manager::ioSample_(Frame* frame, void* context) {
+    ((Manager*)context)->ioSample(static_cast<IOSampleFrame*>(frame));
+  }
+
+  void Manager::nodeIdentification_(Frame* frame, void* context) {
+    NodeIdentificationFrame* nodeIdentification = static_cast<NodeIdentificationFrame*>(frame);
+    ((Manager*)context)->identified(nodeIdentification);
+    delete nodeIdentification;
+  }
+
+  void Manager::receivePacket_(Frame* frame, void* context) {
+    ((Manager*)context)->receivePacket(static_cast<ReceivePacketFrame*>(frame));
+  }
+
+  void Manager::transmitStatus_(Frame* frame, void* context) {
+    ((Manager*)context)->transmitStatus(static_cast<TransmitStatusFrame*>(frame));
+  }
+
+  void Manager::routeRecord_(Frame* frame, void* context) {
+    RouteRecordFrame* routeRecord = static_cast<RouteRecordFrame*>(frame);
+    ((Manager*)context)->recordRoute(routeRecord);
+    delete routeRecord;
+  }
+
+  void Manager::commandResponse(CommandResponseFrame* commandResponse) {
+    commandResponseRouter_.route(commandResponse->getId(), commandResponse);
+  }
+
+  void Manager::remoteCommandResponse(RemoteCommandResponseFrame* remoteResponse) {
+    bool deferred = deferredResponse(remoteResponse);
+    if (remoteResponse->getStatus() == STATUS_TX_FAILURE) {
+      // a deferred command fails like this whenever its module is back asleep, its address still holds
+      if (!deferred) {
+	invalidateAddress16(remoteResponse->getAddress64());
       }
+    }
+    else {
+      received(remoteResponse->getAddress64(), remoteResponse->getAddress16());
+    }
+
+    if (deferred) {
+      delete remoteResponse;
+      return;
+    }
+
+    commandResponse(remoteResponse);
+  }
+
+  void Manager::ioSample(IOSampleFrame* ioSample) {
+    received(ioSample->getAddress64(), ioSample->getAddress16());
+    rules_.evaluate(ioSample);
+    ioSampleQueue_.publish(ioSample);
+  }
+
+  void Manager::receivePacket(ReceivePacketFrame* receivePacket) {
+    received(receivePacket->getAddress64(), receivePacket->getAddress16());
+    receivePacketQueue_.publish(receivePacket);
+  }
+
+  void Manager::transmitStatus(TransmitStatusFrame* transmitStatus) {
+    transmitted(transmitStatus);
+    transmitStatusQueue_.publish(transmitStatus);
+  }
+
+  void* Manager::monitor() {
+    do {
+      serial_.dispatchAny(TIMER_TICK);
+      timerWheel_.advance();
     } while(true);
     
     return NULL;
   }
 }
-
@@ -7,16 +7,52 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
 #include <queue>
+#include <deque>
 #include <pthread.h>
 
 #include "../xbserial/serial.h"
 #include "psq.h"
 #include "mr.h"
+#include "registry.h"
+#include "index.h"
+#include "rtt.h"
+#include "timer.h"
+#include "liveness.h"
+#include "rules.h"
+#include "writer.h"
 
 namespace XB {
 
   typedef PubSubQueueSubscriber<const IOSampleFrame*> IOSampleFrameSubscriber;
+  typedef PubSubQueueSubscriber<const RemoteCommandResponseFrame*> RemoteCommandResponseFrameSubscriber;
+  typedef PubSubQueueSubscriber<const ReceivePacketFrame*> ReceivePacketFrameSubscriber;
+  typedef PubSubQueueSubscriber<const TransmitStatusFrame*> TransmitStatusFrameSubscriber;
+
+  enum ModuleEventType {
+    MODULE_JOINED,
+    MODULE_REJOINED,
+    MODULE_STALE,  // nothing heard for several reporting intervals
+    MODULE_BACK  // heard from again after going stale
+  };
+
+  struct ModuleEvent {
+    ModuleEventType type;
+    Module module;
+
+    ModuleEvent() {
+      type = MODULE_JOINED;
+    }
+
+    ModuleEvent(ModuleEventType type, const Module& module) {
+      this->type = type;
+      this->module = module;
+    }
+  };
+
+  typedef PubSubQueueSubscriber<ModuleEvent> ModuleEventSubscriber;
 
   struct CommandParameter {
     const Command command;
@@ -39,41 +75,204 @@ namespace XB {
     void addCommandParameter(const char* command, unsigned short parameter) {
       commandParameters.push_back(new CommandParameter(command, parameter));
     }
+
+    long reportingInterval() const;
+
+    // FNV-1a over the identifier and every command/parameter pair
+    unsigned long fingerprint() const {
+      unsigned long hash = 2166136261ul;
+      for (std::string::const_iterator it = identifier.begin(); it != identifier.end(); it++) {
+	hash = ((hash ^ (byte)*it) * 16777619ul) & 0xFFFFFFFFul;
+      }
+      for (std::vector<CommandParameter*>::const_iterator it = commandParameters.begin(); it != commandParameters.end(); it++) {
+	const byte* command = (const byte*)&(*it)->command;
+	for (std::size_t index = 0; index < sizeof((*it)->command); index++) {
+	  hash = ((hash ^ command[index]) * 16777619ul) & 0xFFFFFFFFul;
+	}
+	const Parameter& parameter = (*it)->parameter;
+	for (unsigned short index = 0; index < parameter.length; index++) {
+	  hash = ((hash ^ parameter.data[index]) * 16777619ul) & 0xFFFFFFFFul;
+	}
+      }
+
+      return (hash != 0) ? hash : 1;
+    }
+  };
+
+  const char* const DEFAULT_DEVICE = "/dev/ttyUSB0";
+  const int DEFAULT_BAUD = 9600;
+
+  const unsigned short RESPONSE_TIMEOUT = 5000;  // ms
+  const long DEADLINE_FALLBACK = 1000;  // ms a response wait may outlast its deadline when the monitor thread is stuck
+  const int REMOTE_COMMAND_RETRIES = 2;
+
+  const std::size_t DEFAULT_TRANSMIT_WINDOW = 4;  // frames awaiting transmit status
+  const unsigned short TRANSMIT_STATUS_TIMEOUT = 10000;  // ms, frees the slot of a lost status
+
+  class ModuleDiscoveryListener {
+  public:
+    virtual ~ModuleDiscoveryListener() {}
+    // takes ownership of module, returns false to end discovery early
+    virtual bool discovered(Module* module) = 0;
+    virtual void completed(int result) {}
   };
   
-  class Manager {
+  class Manager : private LivenessListener, private RuleActuator {
   public:
     Manager();
     ~Manager();
-    int initialize();
+    int initialize(const char* device = DEFAULT_DEVICE, int baud = DEFAULT_BAUD, FlowControl flowControl = FLOW_NONE);
     int destroy();
-    int discoverModules(std::vector<Module*>& modules);
+    int discoverModules(std::vector<Module*>& modules, std::size_t expectedCount = 0);
+    int discoverModules(std::vector<Module*>& modules, const std::set<Address64>& expectedAddresses);
+    int discoverModules(ModuleDiscoveryListener* listener);
+    int discoverModulesAsync(ModuleDiscoveryListener* listener);
+    int loadRegistry(const char* path = DEFAULT_REGISTRY_PATH);
+    int saveRegistry(const char* path = DEFAULT_REGISTRY_PATH);
+    int getRegisteredModules(std::vector<Module*>& modules);
+    bool findModule(Address64 address64, Module* module);
     int configureModule(Module* module, ModuleConfiguration* configuration);
     int setModuleIdentifier(Module* module, const char* identifier);
     int subscribeIOSample(IOSampleFrameSubscriber* subscriber);
     int unsubscribeIOSample(IOSampleFrameSubscriber* subscriber);
+    int subscribeModuleEvent(ModuleEventSubscriber* subscriber);
+    int unsubscribeModuleEvent(ModuleEventSubscriber* subscriber);
+    int subscribeReceivePacket(ReceivePacketFrameSubscriber* subscriber);
+    int unsubscribeReceivePacket(ReceivePacketFrameSubscriber* subscriber);
+    int subscribeTransmitStatus(TransmitStatusFrameSubscriber* subscriber);
+    int unsubscribeTransmitStatus(TransmitStatusFrameSubscriber* subscriber);
+    byte transmit(Module* module, DataView data, byte options = 0);
+    byte transmit(Module* module, ExplicitAddressing addressing, DataView data, byte options = 0);
+    void setTransmitWindow(std::size_t window);
+    void setPacingWindow(std::size_t window);
+    int getSendStatistics(Priority priority, LaneStatistics* statistics);
+    int setExpectedInterval(Module* module, long interval);
+    bool isModuleStale(Module* module);
+    int addRule(const RuleCondition& condition, const RuleAction& action);
+    int removeRule(int id);
+    int registerFrameType(byte type, FrameDecoder decoder, FrameHandler handler, void* context = NULL);
+    int unregisterFrameType(byte type, FrameHandler handler);
 
   public:
     CommandResponseFrame* sendCommandForResponse(Command command, Parameter parameter = Parameter());
     RemoteCommandResponseFrame* sendRemoteCommandForResponse(Module* module, Command command, Parameter parameter = Parameter(), byte options = 0);
+    RemoteCommandResponseFrame* sendRemoteCommandForResponse(RemoteCommandTemplate* command, Parameter parameter = Parameter());
+    int sendRemoteCommand(RemoteCommandTemplate* command, Parameter parameter = Parameter(), Priority priority = PRIORITY_URGENT);
     int getParameter(Command command, Parameter* parameter);
     int getRemoteParameter(Module* module, Command command, Parameter* parameter);
     int setParameter(Command command, Parameter parameter);
+    int setParameters(const std::vector<CommandParameter*>& commandParameters);
     int setRemoteParameter(Module* module, Command command, Parameter parameter, byte options = 0);
+    int broadcastRemoteCommand(Command command, unsigned short window, RemoteCommandResponseFrameSubscriber* subscriber, Parameter parameter = Parameter(), byte options = 0);
+    int broadcastRemoteCommand(Command command, unsigned short window, std::map<Address64, RemoteCommandResponseFrame*>& responses, Parameter parameter = Parameter(), byte options = 0);
+    int deferRemoteParameter(Module* module, Command command, Parameter parameter, byte options = OPTION_APPLY);
+    unsigned short getRemoteTimeout(Address64 address64);
 
   private:
     byte getNextId();
     CommandResponseFrame* sendCommandForResponse(const CommandFrame& frame);
+    CommandResponseFrame* waitForCommandResponse(byte id, unsigned short timeout = RESPONSE_TIMEOUT, bool last = true);
+    byte sendRemoteCommand(Module* module, Command command, Parameter parameter = Parameter(), byte options = 0, Priority priority = PRIORITY_INTERACTIVE);
+    int sendTemplate(RemoteCommandTemplate* command, const Parameter& parameter, byte id, Priority priority);
+    RemoteCommandResponseFrame* waitForRemoteCommandResponse(byte id, unsigned short timeout = RESPONSE_TIMEOUT, bool last = true);
+    Address16 resolveAddress16(const Module* module);
+    Address16 resolveAddress16(Address64 address64, Address16 address16);
+    void received(Address64 address64, Address16 address16);
+    void invalidateAddress16(Address64 address64);
+    void identified(const NodeIdentificationFrame* nodeIdentification);
+    void recordRoute(const RouteRecordFrame* routeRecord);
+    int sendSourceRoute(Address64 address64, Address16 address16, Priority priority = PRIORITY_INTERACTIVE);
+    byte acquireTransmitSlot(Address64 address64);
+    void releaseTransmitSlot(byte id);
+    void transmitted(const TransmitStatusFrame* transmitStatus);
+    void flushDeferred(Address64 address64, Address16 address16);
+    void measured(Address64 address64, long rtt);
+    void timedOut(Address64 address64);
+    bool deferredResponse(const RemoteCommandResponseFrame* remoteResponse);
+    void stale(Address64 address64);
+    void back(Address64 address64);
+    void actuate(RuleAction& action);
+    int gatherRemoteCommandResponses(Command command, Parameter parameter, byte options, unsigned short window, RemoteCommandResponseFrameSubscriber* subscriber, std::map<Address64, RemoteCommandResponseFrame*>* responses);
+
+  private:
+    int addFrameHandlers();
+    int removeFrameHandlers();
+    static void commandResponse_(Frame* frame, void* context);
+    static void remoteCommandResponse_(Frame* frame, void* context);
+    static void ioSample_(Frame* frame, void* context);
+    static void nodeIdentification_(Frame* frame, void* context);
+    static void receivePacket_(Frame* frame, void* context);
+    static void transmitStatus_(Frame* frame, void* context);
+    static void routeRecord_(Frame* frame, void* context);
+    void commandResponse(CommandResponseFrame* commandResponse);
+    void remoteCommandResponse(RemoteCommandResponseFrame* remoteResponse);
+    void ioSample(IOSampleFrame* ioSample);
+    void receivePacket(ReceivePacketFrame* receivePacket);
+    void transmitStatus(TransmitStatusFrame* transmitStatus);
 
   private:
     static void* monitor_(void* context);
     void* monitor();
+    static void* discover_(void* context);
+    void* discover();
+
+  private:
+    struct FrameType {
+      byte type;
+      FrameDecoder decoder;
+      FrameHandler handler;
+    };
+
+    static const FrameType FRAME_TYPES[];  // handled by the monitor thread
+    static const std::size_t FRAME_TYPE_COUNT;
+
+  private:
+    struct PendingTransmit {
+      Address64 address64;
+      struct timespec sent;
+    };
+
+    struct DeferredCommand {
+      Command command;
+      std::vector<byte> parameter;
+      byte options;
+    };
+
+    struct PendingDeferred {
+      Address64 address64;
+      DeferredCommand command;
+      struct timespec sent;
+    };
 
   private:
     Serial serial_;
+    FrameWriter writer_;
+    TimerWheel timerWheel_;
     pthread_t monitorThread_;
+    pthread_t discoveryThread_;
+    ModuleDiscoveryListener* discoveryListener_;
     MessageRouter<byte, CommandResponseFrame*> commandResponseRouter_;
     PubSubQueue<const IOSampleFrame*> ioSampleQueue_;
+    PubSubQueue<ModuleEvent> moduleEventQueue_;
+    PubSubQueue<const ReceivePacketFrame*> receivePacketQueue_;
+    PubSubQueue<const TransmitStatusFrame*> transmitStatusQueue_;
+    ModuleRegistry registry_;
+    AddressIndex<Address16> addressCache_;
+    pthread_mutex_t addressCacheMutex_;
+    AddressIndex<Route> routeCache_;
+    pthread_mutex_t routeCacheMutex_;
+    std::map<byte, PendingTransmit> pendingTransmits_;
+    std::size_t transmitWindow_;
+    pthread_mutex_t transmitMutex_;
+    pthread_cond_t transmitCond_;
+    AddressIndex<std::deque<DeferredCommand> > deferredCommands_;
+    std::map<byte, PendingDeferred> deferredResponses_;
+    int deferredCount_;
+    pthread_mutex_t deferredMutex_;
+    AddressIndex<RttEstimator> rttEstimators_;
+    pthread_mutex_t rttMutex_;
+    LivenessMonitor liveness_;
+    RuleEngine rules_;
     byte idSequence_;
   };
   
@@ -6,22 +6,30 @@
 #define _MR_H_
 
 #include <map>
+#include <queue>
 #include <pthread.h>
 
+#include "psq.h"
+
 namespace XB {
 
   template<typename K, typename T>
     class MessageRouter {
   public:
-    MessageRouter();
+    MessageRouter(default_delete<T> _delete = default_delete<T>());
     ~MessageRouter();
     int initialize();
     int destroy();
     int route(K key, T message);
     T waitForMessage(K key, unsigned short timeout = 0);
+    int discard(K key);
+    int expect(K key);
+    int expire(K key);
 
   private:
-    std::map<K, T> map_;
+    default_delete<T> delete_;
+    std::map<K, std::queue<T> > map_;
+    std::map<K, bool> waiting_;  // keys expected, and whether the current wait's deadline passed
     pthread_mutex_t mapMutex_;
     pthread_cond_t mapCond_;
   };
@@ -3,11 +3,13 @@
 /*********************************************************************/
 
 #include <sys/time.h>
+#include <errno.h>
 
 namespace XB {
 
   template<typename K, typename T>
-  MessageRouter<K, T>::MessageRouter() {
+  MessageRouter<K, T>::MessageRouter(default_delete<T> _delete) {
+    delete_ = _delete;
   }
 
   template<typename K, typename T>
@@ -41,7 +43,15 @@ namespace XB {
       return result;
     }
 
-    map_[key] = message;
+    // nobody expects the key: a late response to a wait that already ended
+    if (waiting_.find(key) == waiting_.end()) {
+      pthread_mutex_unlock(&mapMutex_);
+      delete_._delete(message);
+      return 0;
+    }
+
+    // several messages may share a key (responses to a broadcast)
+    map_[key].push(message);
 
     pthread_cond_broadcast(&mapCond_);
 
@@ -55,28 +65,103 @@ namespace XB {
       return NULL;
     }
 
+    timespec ts;
     if (timeout > 0) {
       timeval now;
       gettimeofday(&now, NULL);
-      
-      timespec ts;
+
       ts.tv_sec = now.tv_sec + (timeout / 1000);
       ts.tv_nsec = (now.tv_usec * 1000) + ((timeout % 1000) * 1000000);
-      pthread_cond_timedwait(&mapCond_, &mapMutex_, &ts);
-    }
-    else {
-      pthread_cond_wait(&mapCond_, &mapMutex_);
+      if (ts.tv_nsec >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+      }
     }
 
+    // the message may already have been routed (pipelined requests), so look before waiting
     T value = NULL;
-    typename std::map<K, T>::iterator it = map_.find(key);
+    typename std::map<K, std::queue<T> >::iterator it;
+    if (waiting_.find(key) == waiting_.end()) {
+      waiting_[key] = false;
+    }
+    while (((it = map_.find(key)) == map_.end()) && !waiting_[key]) {
+      if (timeout > 0) {
+	result = pthread_cond_timedwait(&mapCond_, &mapMutex_, &ts);
+      }
+      else {
+	result = pthread_cond_wait(&mapCond_, &mapMutex_);
+      }
+
+      if (result == ETIMEDOUT) {
+	break;
+      }
+    }
+    // the key stays expected, more messages may follow until it is discarded
+    waiting_[key] = false;
+
     if (it != map_.end()) {
-      value = it->second;
-      map_.erase(it);
+      value = it->second.front();
+      it->second.pop();
+      if (it->second.empty()) {
+	map_.erase(it);
+      }
     }
 
     pthread_mutex_unlock(&mapMutex_);
 
     return value;
   }
+
+  // stops expecting key, whatever was routed to it and not taken is deleted
+  template<typename K, typename T>
+  int MessageRouter<K, T>::discard(K key) {
+    int result = pthread_mutex_lock(&mapMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    waiting_.erase(key);
+
+    typename std::map<K, std::queue<T> >::iterator it = map_.find(key);
+    if (it != map_.end()) {
+      while (!it->second.empty()) {
+	delete_._delete(it->second.front());
+	it->second.pop();
+      }
+      map_.erase(it);
+    }
+
+    return pthread_mutex_unlock(&mapMutex_);
+  }
+
+  // registers key before whatever it answers is sent: only expected keys are routed,
+  // and an expire ahead of waitForMessage is not lost
+  template<typename K, typename T>
+  int MessageRouter<K, T>::expect(K key) {
+    int result = pthread_mutex_lock(&mapMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    waiting_[key] = false;
+
+    return pthread_mutex_unlock(&mapMutex_);
+  }
+
+  // ends a wait for key that has no deadline of its own
+  template<typename K, typename T>
+  int MessageRouter<K, T>::expire(K key) {
+    int result = pthread_mutex_lock(&mapMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    typename std::map<K, bool>::iterator it = waiting_.find(key);
+    if (it != waiting_.end()) {
+      it->second = true;
+      pthread_cond_broadcast(&mapCond_);
+    }
+
+    return pthread_mutex_unlock(&mapMutex_);
+  }
 }
@@ -36,7 +36,8 @@ namespace XB {
     class PubSubQueueSubscriber {
   public:
     virtual ~PubSubQueueSubscriber() {}
-    virtual void received(T) = 0;
+    // the queue deletes value once every subscriber has been called, so it must not be kept after returning
+    virtual void received(T value) = 0;
   };
 
   template<class T>
@@ -132,11 +132,13 @@ namespace XB {
 	continue;
       }
 
+      // values live until every subscriber has seen them
       while (!queueCopy.empty()) {
 	T current = queueCopy.front();
 	for (typename std::list<PubSubQueueSubscriber<T>*>::iterator it = subscribersCopy.begin(); it != subscribersCopy.end(); it++) {
 	  (*it)->received(current);
 	}
+	delete_._delete(current);
 	queueCopy.pop();
       }
     }
@@ -0,0 +1,206 @@
+/*********************************************************************/
+/* registry                                                          */
+/*********************************************************************/
+
+#include "registry.h"
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace XB {
+
+  const char REGISTRY_MAGIC[4] = {'X', 'B', 'M', 'R'};
+  const uint32_t REGISTRY_VERSION = 1;
+
+  ModuleRegistry::ModuleRegistry() {
+  }
+
+  ModuleRegistry::~ModuleRegistry() {
+  }
+
+  int ModuleRegistry::initialize() {
+    return pthread_mutex_init(&entriesMutex_, NULL);
+  }
+
+  int ModuleRegistry::destroy() {
+    return pthread_mutex_destroy(&entriesMutex_);
+  }
+
+  int ModuleRegistry::load(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return fd;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (st.st_size < (off_t)sizeof(RegistryHeader))) {
+      ::close(fd);
+      return ERROR_REGISTRY_FORMAT;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      return -1;
+    }
+
+    const RegistryHeader* header = (const RegistryHeader*)map;
+    if ((memcmp(header->magic, REGISTRY_MAGIC, sizeof(REGISTRY_MAGIC)) != 0) || (header->version != REGISTRY_VERSION) ||
+	(st.st_size < (off_t)(sizeof(RegistryHeader) + (header->count * sizeof(RegistryRecord))))) {
+      munmap(map, st.st_size);
+      return ERROR_REGISTRY_FORMAT;
+    }
+
+    int result = pthread_mutex_lock(&entriesMutex_);
+    if (result != 0) {
+      munmap(map, st.st_size);
+      return result;
+    }
+
+    const RegistryRecord* records = (const RegistryRecord*)(header + 1);
+    for (uint32_t index = 0; index < header->count; index++) {
+      const RegistryRecord& record = records[index];
+      Entry entry;
+      entry.module.address64 = Address64((byte*)record.address64);
+      entry.module.address16 = Address16((byte*)record.address16);
+      entry.module.identifier = std::string(record.identifier, strnlen(record.identifier, sizeof(record.identifier)));
+      entry.module.fingerprint = record.fingerprint;
+      entry.lastSeen = (time_t)record.lastSeen;
+      entries_[entry.module.address64] = entry;
+    }
+
+    pthread_mutex_unlock(&entriesMutex_);
+
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  int ModuleRegistry::save(const char* path) {
+    int result = pthread_mutex_lock(&entriesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    std::vector<RegistryRecord> records;
+    Address64 address64;
+    Entry* current;
+    for (std::size_t slot = 0; slot < entries_.capacity(); slot++) {
+      if (!entries_.at(slot, &address64, &current)) {
+	continue;
+      }
+
+      const Entry& entry = *current;
+      RegistryRecord record;
+      memset(&record, 0, sizeof(record));
+      record.lastSeen = (uint64_t)entry.lastSeen;
+      record.fingerprint = (uint32_t)entry.module.fingerprint;
+      record.address16[0] = entry.module.address16.a;
+      record.address16[1] = entry.module.address16.b;
+      entry.module.address64.data(record.address64);
+      strncpy(record.identifier, entry.module.identifier.c_str(), sizeof(record.identifier) - 1);
+      records.push_back(record);
+    }
+
+    pthread_mutex_unlock(&entriesMutex_);
+
+    RegistryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REGISTRY_MAGIC, sizeof(REGISTRY_MAGIC));
+    header.version = REGISTRY_VERSION;
+    header.count = records.size();
+
+    // write aside and rename, so a crash never leaves a truncated registry
+    std::string temporary = std::string(path) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) {
+      return -1;
+    }
+
+    if ((fwrite(&header, sizeof(header), 1, file) != 1) ||
+	(!records.empty() && (fwrite(&records[0], sizeof(RegistryRecord), records.size(), file) != records.size()))) {
+      fclose(file);
+      unlink(temporary.c_str());
+      return -1;
+    }
+
+    if (fclose(file) != 0) {
+      unlink(temporary.c_str());
+      return -1;
+    }
+
+    return rename(temporary.c_str(), path);
+  }
+
+  int ModuleRegistry::update(const Module& module) {
+    int result = pthread_mutex_lock(&entriesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    Entry& entry = entries_[module.address64];
+    entry.module = module;
+    entry.lastSeen = time(NULL);
+
+    return pthread_mutex_unlock(&entriesMutex_);
+  }
+
+  int ModuleRegistry::touch(Address64 address64, Address16 address16) {
+    int result = pthread_mutex_lock(&entriesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    Entry* entry = entries_.find(address64);
+    if (entry != NULL) {
+      if (address16 != UNKNOWN) {
+	entry->module.address16 = address16;
+      }
+      entry->lastSeen = time(NULL);
+    }
+
+    return pthread_mutex_unlock(&entriesMutex_);
+  }
+
+  bool ModuleRegistry::find(Address64 address64, Module* module, time_t* lastSeen) {
+    if (pthread_mutex_lock(&entriesMutex_) != 0) {
+      return false;
+    }
+
+    Entry* entry = entries_.find(address64);
+    bool found = (entry != NULL);
+    if (found) {
+      if (module != NULL) {
+	*module = entry->module;
+      }
+      if (lastSeen != NULL) {
+	*lastSeen = entry->lastSeen;
+      }
+    }
+
+    pthread_mutex_unlock(&entriesMutex_);
+
+    return found;
+  }
+
+  int ModuleRegistry::getModules(std::vector<Module*>& modules) {
+    int result = pthread_mutex_lock(&entriesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    Address64 address64;
+    Entry* entry;
+    for (std::size_t slot = 0; slot < entries_.capacity(); slot++) {
+      if (entries_.at(slot, &address64, &entry)) {
+	modules.push_back(new Module(entry->module));
+      }
+    }
+
+    return pthread_mutex_unlock(&entriesMutex_);
+  }
+}
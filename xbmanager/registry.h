@@ -0,0 +1,63 @@
+/*********************************************************************/
+/* registry                                                          */
+/*********************************************************************/
+
+#ifndef _REGISTRY_H_
+#define _REGISTRY_H_
+
+#include <vector>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "../xbserial/command.h"
+#include "index.h"
+
+namespace XB {
+
+  const char* const DEFAULT_REGISTRY_PATH = "xbm.registry";
+
+  const int ERROR_REGISTRY_FORMAT = -300;
+
+  // on-disk layout: RegistryHeader followed by count fixed size RegistryRecords
+  struct RegistryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+  };
+
+  struct RegistryRecord {
+    uint64_t lastSeen;
+    uint32_t fingerprint;
+    byte address16[2];
+    byte address64[8];
+    char identifier[26];  // NI is at most 20 characters
+  };
+
+  class ModuleRegistry {
+  public:
+    ModuleRegistry();
+    ~ModuleRegistry();
+    int initialize();
+    int destroy();
+    int load(const char* path);
+    int save(const char* path);
+    int update(const Module& module);
+    int touch(Address64 address64, Address16 address16);
+    bool find(Address64 address64, Module* module, time_t* lastSeen = NULL);
+    int getModules(std::vector<Module*>& modules);
+
+  private:
+    struct Entry {
+      Module module;
+      time_t lastSeen;
+    };
+
+  private:
+    AddressIndex<Entry> entries_;
+    pthread_mutex_t entriesMutex_;
+  };
+}
+
+#endif // _REGISTRY_H_
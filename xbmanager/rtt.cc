@@ -0,0 +1,54 @@
+/*********************************************************************/
+/* rtt                                                               */
+/*********************************************************************/
+
+#include "rtt.h"
+
+namespace XB {
+
+  RttEstimator::RttEstimator() {
+    srtt_ = 0;
+    rttvar_ = 0;
+    rto_ = INITIAL_TIMEOUT;
+  }
+
+  void RttEstimator::sample(long rtt) {
+    if (srtt_ == 0) {
+      srtt_ = rtt;
+      rttvar_ = rtt / 2;
+    }
+    else {
+      long delta = (srtt_ > rtt) ? (srtt_ - rtt) : (rtt - srtt_);
+      rttvar_ = ((3 * rttvar_) + delta) / 4;  // beta = 1/4
+      srtt_ = ((7 * srtt_) + rtt) / 8;  // alpha = 1/8
+    }
+
+    rto_ = srtt_ + (4 * rttvar_);
+    if (rto_ < MIN_TIMEOUT) {
+      rto_ = MIN_TIMEOUT;
+    }
+    else if (rto_ > MAX_TIMEOUT) {
+      rto_ = MAX_TIMEOUT;
+    }
+  }
+
+  // after a timeout; the retry's round trip is ambiguous and not sampled (Karn)
+  void RttEstimator::backoff() {
+    rto_ *= 2;
+    if (rto_ > MAX_TIMEOUT) {
+      rto_ = MAX_TIMEOUT;
+    }
+  }
+
+  long RttEstimator::getSmoothedRtt() const {
+    return srtt_;
+  }
+
+  long RttEstimator::getRttVariation() const {
+    return rttvar_;
+  }
+
+  unsigned short RttEstimator::getTimeout() const {
+    return (unsigned short)rto_;
+  }
+}
@@ -0,0 +1,31 @@
+/*********************************************************************/
+/* rtt                                                               */
+/*********************************************************************/
+
+#ifndef _RTT_H_
+#define _RTT_H_
+
+namespace XB {
+
+  const long INITIAL_TIMEOUT = 3000;  // ms, before the first measurement
+  const long MIN_TIMEOUT = 200;
+  const long MAX_TIMEOUT = 30000;
+
+  // smoothed round-trip time and variation, as TCP's retransmission timer (RFC 6298)
+  class RttEstimator {
+  public:
+    RttEstimator();
+    void sample(long rtt);
+    void backoff();
+    long getSmoothedRtt() const;
+    long getRttVariation() const;
+    unsigned short getTimeout() const;
+
+  private:
+    long srtt_;
+    long rttvar_;
+    long rto_;
+  };
+}
+
+#endif // _RTT_H_
@@ -0,0 +1,133 @@
+/*********************************************************************/
+/* rules                                                             */
+/*********************************************************************/
+
+#include "rules.h"
+
+namespace XB {
+
+  RuleEngine::RuleEngine() {
+    actuator_ = NULL;
+    idSequence_ = 0;
+  }
+
+  RuleEngine::~RuleEngine() {
+  }
+
+  int RuleEngine::initialize(RuleActuator* actuator) {
+    actuator_ = actuator;
+
+    return pthread_mutex_init(&rulesMutex_, NULL);
+  }
+
+  int RuleEngine::destroy() {
+    rules_.clear();
+    sources_.clear();
+
+    return pthread_mutex_destroy(&rulesMutex_);
+  }
+
+  // returns the rule's id, or a negative error
+  int RuleEngine::add(const RuleCondition& condition, const RuleAction& action) {
+    int result = pthread_mutex_lock(&rulesMutex_);
+    if (result != 0) {
+      return -result;
+    }
+
+    int id = ++idSequence_;
+    rules_[condition.source].push_back(Rule(id, condition, action));
+    sources_[id] = condition.source;
+
+    pthread_mutex_unlock(&rulesMutex_);
+
+    return id;
+  }
+
+  int RuleEngine::remove(int id) {
+    int result = pthread_mutex_lock(&rulesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    std::map<int, Address64>::iterator it = sources_.find(id);
+    if (it != sources_.end()) {
+      std::vector<Rule>* rules = rules_.find(it->second);
+      for (std::vector<Rule>::iterator rule = rules->begin(); rule != rules->end(); rule++) {
+	if (rule->id == id) {
+	  rules->erase(rule);
+	  break;
+	}
+      }
+      if (rules->empty()) {
+	rules_.erase(it->second);
+      }
+      sources_.erase(it);
+    }
+
+    return pthread_mutex_unlock(&rulesMutex_);
+  }
+
+  void RuleEngine::evaluate(const IOSampleFrame* ioSample) {
+    if (pthread_mutex_lock(&rulesMutex_) != 0) {
+      return;
+    }
+
+    std::vector<Rule>* rules = rules_.find(ioSample->getAddress64());
+    if (rules != NULL) {
+      for (std::vector<Rule>::iterator it = rules->begin(); it != rules->end(); it++) {
+	int current = level(*it, ioSample);
+	if (current < 0) {
+	  continue;
+	}
+
+	int previous = it->level;
+	it->level = current;
+
+	bool fire = false;
+	switch (it->condition.trigger) {
+	case TRIGGER_HIGH:
+	case TRIGGER_ABOVE:
+	  fire = (current == 1);
+	  break;
+	case TRIGGER_LOW:
+	case TRIGGER_BELOW:
+	  fire = (current == 0);
+	  break;
+	case TRIGGER_RISING:
+	case TRIGGER_CROSSING_ABOVE:
+	  fire = (previous == 0) && (current == 1);
+	  break;
+	case TRIGGER_FALLING:
+	case TRIGGER_CROSSING_BELOW:
+	  fire = (previous == 1) && (current == 0);
+	  break;
+	}
+
+	if (fire) {
+	  actuator_->actuate(it->action);
+	}
+      }
+    }
+
+    pthread_mutex_unlock(&rulesMutex_);
+  }
+
+  // 1 or 0 for the condition's pin, -1 when the sample does not carry it
+  int RuleEngine::level(const Rule& rule, const IOSampleFrame* ioSample) {
+    switch (rule.condition.trigger) {
+    case TRIGGER_HIGH:
+    case TRIGGER_LOW:
+    case TRIGGER_RISING:
+    case TRIGGER_FALLING:
+      if (!ioSample->isDigitalPinEnabled(rule.condition.pin)) {
+	return -1;
+      }
+      return ioSample->isDigitalPinSet(rule.condition.pin) ? 1 : 0;
+    default:
+      if (!ioSample->isAnalogPinEnabled(rule.condition.pin)) {
+	return -1;
+      }
+      return (ioSample->getAnalogPinSample(rule.condition.pin).ushort() > rule.condition.threshold) ? 1 : 0;
+    }
+  }
+}
@@ -0,0 +1,94 @@
+/*********************************************************************/
+/* rules                                                             */
+/*********************************************************************/
+
+#ifndef _RULES_H_
+#define _RULES_H_
+
+#include <vector>
+#include <map>
+#include <pthread.h>
+
+#include "../xbserial/command.h"
+#include "../xbserial/iosample.h"
+#include "index.h"
+
+namespace XB {
+
+  enum RuleTrigger {
+    TRIGGER_HIGH,  // digital pin set, on every sample
+    TRIGGER_LOW,
+    TRIGGER_RISING,  // digital pin set, once per edge
+    TRIGGER_FALLING,
+    TRIGGER_ABOVE,  // analog sample over the threshold, on every sample
+    TRIGGER_BELOW,
+    TRIGGER_CROSSING_ABOVE,  // analog sample over the threshold, once per crossing
+    TRIGGER_CROSSING_BELOW
+  };
+
+  struct RuleCondition {
+    Address64 source;
+    RuleTrigger trigger;
+    PIN pin;
+    unsigned short threshold;
+
+    RuleCondition(Address64 source, RuleTrigger trigger, PIN pin, unsigned short threshold = 0) {
+      this->source = source;
+      this->trigger = trigger;
+      this->pin = pin;
+      this->threshold = threshold;
+    }
+  };
+
+  struct RuleAction {
+    RemoteCommandTemplate command;  // encoded once, when the rule is added
+    Parameter parameter;
+
+  RuleAction(Address64 target, Command command, Parameter parameter, byte options = OPTION_APPLY) : command(target, UNKNOWN, options, command), parameter(parameter) {
+    }
+  };
+
+  class RuleActuator {
+  public:
+    virtual ~RuleActuator() {}
+    // runs on the thread evaluating the sample and must not block
+    virtual void actuate(RuleAction& action) = 0;
+  };
+
+  // rules are indexed by source module, so a sample is only matched against its own module's rules
+  class RuleEngine {
+  public:
+    RuleEngine();
+    ~RuleEngine();
+    int initialize(RuleActuator* actuator);
+    int destroy();
+    int add(const RuleCondition& condition, const RuleAction& action);
+    int remove(int id);
+    void evaluate(const IOSampleFrame* ioSample);
+
+  private:
+    struct Rule {
+      int id;
+      RuleCondition condition;
+      RuleAction action;
+      int level;  // of the condition's pin at the last sample, -1 before the first
+
+    Rule(int id, const RuleCondition& condition, const RuleAction& action) : condition(condition), action(action) {
+	this->id = id;
+	level = -1;
+      }
+    };
+
+  private:
+    static int level(const Rule& rule, const IOSampleFrame* ioSample);
+
+  private:
+    RuleActuator* actuator_;
+    AddressIndex<std::vector<Rule> > rules_;
+    std::map<int, Address64> sources_;
+    int idSequence_;
+    pthread_mutex_t rulesMutex_;
+  };
+}
+
+#endif // _RULES_H_
@@ -0,0 +1,114 @@
+/*********************************************************************/
+/* sampling                                                          */
+/*********************************************************************/
+
+#include "sampling.h"
+
+#include <math.h>
+
+#include "../xbserial/log.h"
+
+namespace XB {
+
+  const float SAMPLING_WEIGHT = 0.125f;  // of a new sample in the moving mean and variance
+
+  static const PIN ANALOG_PINS[SAMPLING_CHANNELS] = { A0, A1, A2, A3 };
+
+  SamplingController::SamplingController(Manager& manager, const SamplingPolicy& policy) : manager_(manager) {
+    policy_ = policy;
+  }
+
+  SamplingController::~SamplingController() {
+  }
+
+  void SamplingController::received(const IOSampleFrame* ioSample) {
+    Address64 address64 = ioSample->getAddress64();
+
+    State* state = states_.find(address64);
+    if (state == NULL) {
+      state = &states_[address64];
+      state->interval = policy_.initialInterval;
+      state->samples = 0;
+      state->digitalChanged = false;
+      state->digitalSample = ioSample->getDigitalSample();
+      for (int channel = 0; channel < SAMPLING_CHANNELS; channel++) {
+	state->channels[channel].mean = ioSample->isAnalogPinEnabled(ANALOG_PINS[channel]) ? ioSample->getAnalogPinSample(ANALOG_PINS[channel]).ushort() : 0.0f;
+	state->channels[channel].variance = 0.0f;
+      }
+      return;
+    }
+
+    float deviation = observe(*state, ioSample);
+    if (++state->samples < policy_.settleSamples) {
+      return;
+    }
+
+    // the gap between the two thresholds keeps a module near either one from flapping
+    if (state->digitalChanged || (deviation > policy_.highDeviation)) {
+      if (state->interval > policy_.minInterval) {
+	adjust(address64, *state, (state->interval / 2 > policy_.minInterval) ? state->interval / 2 : policy_.minInterval);
+      }
+    }
+    else if (deviation < policy_.lowDeviation) {
+      if (state->interval < policy_.maxInterval) {
+	adjust(address64, *state, (state->interval < policy_.maxInterval / 2) ? state->interval * 2 : policy_.maxInterval);
+      }
+    }
+  }
+
+  // folds the sample into the moving statistics, returning the largest channel deviation
+  float SamplingController::observe(State& state, const IOSampleFrame* ioSample) {
+    if (ioSample->getDigitalMask().ushort() != 0) {
+      Sample digitalSample = ioSample->getDigitalSample();
+      if (digitalSample != state.digitalSample) {
+	state.digitalChanged = true;
+	state.digitalSample = digitalSample;
+      }
+    }
+
+    float deviation = 0.0f;
+    for (int channel = 0; channel < SAMPLING_CHANNELS; channel++) {
+      if (!ioSample->isAnalogPinEnabled(ANALOG_PINS[channel])) {
+	continue;
+      }
+
+      Channel& current = state.channels[channel];
+      float difference = ioSample->getAnalogPinSample(ANALOG_PINS[channel]).ushort() - current.mean;
+      current.mean += SAMPLING_WEIGHT * difference;
+      current.variance = (1.0f - SAMPLING_WEIGHT) * (current.variance + (SAMPLING_WEIGHT * difference * difference));
+
+      float channelDeviation = sqrtf(current.variance);
+      if (channelDeviation > deviation) {
+	deviation = channelDeviation;
+      }
+    }
+
+    return deviation;
+  }
+
+  // deferred, so the change goes out when the module is next heard, awake or not
+  void SamplingController::adjust(Address64 address64, State& state, unsigned short interval) {
+    Module module;
+    if (!manager_.findModule(address64, &module)) {
+      module = Module(address64, UNKNOWN, "");
+    }
+
+    Parameter parameter(interval);
+    int result = manager_.deferRemoteParameter(&module, Command("IR"), parameter);
+    if (result != 0) {
+      logError(result, "Failed to change the sampling interval of module '%s'", module.identifier.c_str());
+      return;
+    }
+
+    log("Sampling module '%s' every %u ms", module.identifier.c_str(), interval);
+
+    // only ever lengthened: a sleeping module may still report no faster than its sleep period
+    if (interval > state.interval) {
+      manager_.setExpectedInterval(&module, interval);
+    }
+
+    state.interval = interval;
+    state.samples = 0;
+    state.digitalChanged = false;
+  }
+}
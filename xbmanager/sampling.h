@@ -0,0 +1,65 @@
+/*********************************************************************/
+/* sampling                                                          */
+/*********************************************************************/
+
+#ifndef _SAMPLING_H_
+#define _SAMPLING_H_
+
+#include "manager.h"
+
+namespace XB {
+
+  const int SAMPLING_CHANNELS = 4;  // A0-A3
+
+  struct SamplingPolicy {
+    unsigned short initialInterval;  // ms, the IR modules are configured with
+    unsigned short minInterval;  // ms
+    unsigned short maxInterval;  // ms
+    float lowDeviation;  // ADC counts, below it sampling slows down
+    float highDeviation;  // ADC counts, above it sampling speeds up
+    unsigned int settleSamples;  // samples taken at a new rate before it is judged
+
+    SamplingPolicy() {
+      initialInterval = 50;
+      minInterval = 50;
+      maxInterval = 10000;
+      lowDeviation = 2.0f;
+      highDeviation = 8.0f;
+      settleSamples = 8;
+    }
+  };
+
+  // adjusts each module's IR to how much its inputs change; received() runs on the IO sample
+  // queue's thread only, so the per-module state needs no locking
+  class SamplingController : public IOSampleFrameSubscriber {
+  public:
+    SamplingController(Manager& manager, const SamplingPolicy& policy = SamplingPolicy());
+    ~SamplingController();
+    void received(const IOSampleFrame* ioSample);
+
+  private:
+    struct Channel {
+      float mean;
+      float variance;
+    };
+
+    struct State {
+      unsigned short interval;
+      unsigned int samples;
+      bool digitalChanged;
+      Sample digitalSample;
+      Channel channels[SAMPLING_CHANNELS];
+    };
+
+  private:
+    float observe(State& state, const IOSampleFrame* ioSample);
+    void adjust(Address64 address64, State& state, unsigned short interval);
+
+  private:
+    Manager& manager_;
+    SamplingPolicy policy_;
+    AddressIndex<State> states_;
+  };
+}
+
+#endif // _SAMPLING_H_
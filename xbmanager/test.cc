@@ -0,0 +1,193 @@
+#include "test.h"
+
+#include <map>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../xbserial/log.h"
+#include "index.h"
+#include "mr.h"
+#include "rtt.h"
+#include "timer.h"
+
+using namespace XB;
+
+static int failures = 0;
+
+bool check(bool passed, const char* condition, const char* file, int line) {
+  if (!passed) {
+    log("%s:%d: %s failed", file, line, condition);
+    failures++;
+  }
+
+  return passed;
+}
+
+static Address64 address(unsigned int n) {
+  return Address64(0x00, 0x13, 0xA2, 0x00, (byte)(n >> 24), (byte)(n >> 16), (byte)(n >> 8), (byte)n);
+}
+
+// a small table keeps probe runs long and wrapping, so erase has to shift entries back across them
+static void testAddressIndexErase() {
+  AddressIndex<unsigned int> index(8);
+  std::map<unsigned int, unsigned int> expected;
+
+  srand(1);
+  for (int round = 0; round < 2000; round++) {
+    unsigned int n = rand() % 24;
+    if ((rand() % 3) == 0) {
+      CHECK(index.erase(address(n)) == (expected.erase(n) == 1));
+    }
+    else {
+      index[address(n)] = round;
+      expected[n] = round;
+    }
+
+    CHECK(index.size() == expected.size());
+    for (unsigned int k = 0; k < 24; k++) {
+      unsigned int* value = index.find(address(k));
+      std::map<unsigned int, unsigned int>::iterator it = expected.find(k);
+      if (it == expected.end()) {
+	CHECK(value == NULL);
+      }
+      else if (CHECK(value != NULL)) {
+	CHECK(*value == it->second);
+      }
+    }
+  }
+
+  CHECK(!index.erase(address(100)));
+}
+
+// a response to an attempt that timed out must not reach the next user of its id
+static void testLateResponseDropped() {
+  MessageRouter<int, int*> router;
+  router.initialize();
+
+  router.expect(7);
+  router.expire(7);
+  CHECK(router.waitForMessage(7) == NULL);
+  router.discard(7);
+
+  router.route(7, new int(1));  // the late response
+  router.expect(7);
+  router.route(7, new int(2));
+  int* message = router.waitForMessage(7);
+  if (CHECK(message != NULL)) {
+    CHECK(*message == 2);
+  }
+  delete message;
+  router.expire(7);
+  CHECK(router.waitForMessage(7) == NULL);
+  router.discard(7);
+
+  router.destroy();
+}
+
+static void testRttEstimator() {
+  RttEstimator estimator;
+  CHECK(estimator.getTimeout() == INITIAL_TIMEOUT);
+
+  estimator.sample(100);
+  CHECK(estimator.getSmoothedRtt() == 100);
+  CHECK(estimator.getRttVariation() == 50);
+  CHECK(estimator.getTimeout() == 300);
+
+  for (int round = 0; round < 50; round++) {
+    estimator.sample(10);
+  }
+  CHECK(estimator.getTimeout() == MIN_TIMEOUT);
+
+  // each timeout doubles, up to the bound
+  estimator.backoff();
+  CHECK(estimator.getTimeout() == 2 * MIN_TIMEOUT);
+  for (int round = 0; round < 20; round++) {
+    estimator.backoff();
+  }
+  CHECK(estimator.getTimeout() == MAX_TIMEOUT);
+
+  estimator.sample(60000);
+  CHECK(estimator.getTimeout() == MAX_TIMEOUT);
+}
+
+static long milliseconds() {
+  struct timespec current;
+  clock_gettime(CLOCK_MONOTONIC, &current);
+  return ((long)current.tv_sec * 1000) + (current.tv_nsec / 1000000);
+}
+
+class RecordingTimer : public Timer {
+public:
+  RecordingTimer() {
+    fired = 0;
+    firedAt = 0;
+  }
+
+protected:
+  void expired() {
+    fired++;
+    firedAt = milliseconds();
+  }
+
+public:
+  int fired;
+  long firedAt;
+};
+
+// advances wheel every few ms for duration ms
+static void run(TimerWheel* wheel, long duration) {
+  long end = milliseconds() + duration;
+  while (milliseconds() < end) {
+    wheel->advance();
+    usleep(2000);
+  }
+}
+
+static void testTimerWheel() {
+  TimerWheel wheel;
+  wheel.initialize();
+
+  // level 0, level 1 (more than 64 ticks, so it cascades down), and one cancelled
+  RecordingTimer soon;
+  RecordingTimer later;
+  RecordingTimer cancelled;
+  long start = milliseconds();
+  wheel.arm(&soon, 30);
+  wheel.arm(&later, 700);
+  wheel.arm(&cancelled, 50);
+  CHECK(wheel.cancel(&cancelled));
+  CHECK(!cancelled.isArmed());
+
+  run(&wheel, 900);
+  CHECK(soon.fired == 1);
+  CHECK(soon.firedAt - start >= 30);
+  CHECK(later.fired == 1);
+  CHECK(later.firedAt - start >= 700);
+  CHECK(!later.isArmed());
+  CHECK(cancelled.fired == 0);
+  CHECK(!wheel.cancel(&soon));
+
+  // armed while the wheel lags the clock by a missed stretch of ticks
+  usleep(200000);
+  RecordingTimer lagging;
+  start = milliseconds();
+  wheel.arm(&lagging, 100);
+  wheel.advance();
+  CHECK(lagging.fired == 0);
+  run(&wheel, 200);
+  CHECK(lagging.fired == 1);
+  CHECK(lagging.firedAt - start >= 100);
+
+  wheel.destroy();
+}
+
+int main(int argc, char **argv) {
+  testAddressIndexErase();
+  testLateResponseDropped();
+  testRttEstimator();
+  testTimerWheel();
+
+  log("%d failed", failures);
+  return (failures == 0) ? 0 : 1;
+}
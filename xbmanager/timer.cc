@@ -0,0 +1,206 @@
+/*********************************************************************/
+/* timer                                                             */
+/*********************************************************************/
+
+#include "timer.h"
+
+#include <time.h>
+#include <stddef.h>
+
+namespace XB {
+
+  Timer::Timer() {
+    next_ = NULL;
+    pprev_ = NULL;
+    expiry_ = 0;
+  }
+
+  Timer::~Timer() {
+  }
+
+  bool Timer::isArmed() const {
+    return pprev_ != NULL;
+  }
+
+
+  TimerWheel::TimerWheel() {
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+      for (int slot = 0; slot < TIMER_SLOTS; slot++) {
+	slots_[level][slot] = NULL;
+      }
+    }
+    expired_ = NULL;
+    current_ = 0;
+    running_ = NULL;
+  }
+
+  TimerWheel::~TimerWheel() {
+  }
+
+  int TimerWheel::initialize() {
+    current_ = now();
+
+    int result = pthread_mutex_init(&wheelMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    return pthread_cond_init(&wheelCond_, NULL);
+  }
+
+  int TimerWheel::destroy() {
+    int result = pthread_cond_destroy(&wheelCond_);
+    if (result != 0) {
+      return result;
+    }
+
+    return pthread_mutex_destroy(&wheelMutex_);
+  }
+
+  int TimerWheel::arm(Timer* timer, long delay) {
+    int result = pthread_mutex_lock(&wheelMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    if (timer->pprev_ != NULL) {
+      unlink(timer);
+    }
+
+    // current_ lags the clock between ticks and behind a slow one, counting from it would fire early.
+    // Part of the clock's tick has gone already, so one more tick keeps the timer from firing before delay
+    unsigned long long start = now();
+    if (start < current_) {
+      start = current_;
+    }
+
+    long ticks = (delay + TIMER_TICK - 1) / TIMER_TICK;
+    timer->expiry_ = start + ((ticks > 0) ? ticks : 0) + 1;
+    insert(timer);
+
+    return pthread_mutex_unlock(&wheelMutex_);
+  }
+
+  // once cancel returns the timer's expired() is neither running nor going to run
+  bool TimerWheel::cancel(Timer* timer) {
+    if (pthread_mutex_lock(&wheelMutex_) != 0) {
+      return false;
+    }
+
+    while ((running_ == timer) && !pthread_equal(runner_, pthread_self())) {
+      pthread_cond_wait(&wheelCond_, &wheelMutex_);
+    }
+
+    bool armed = (timer->pprev_ != NULL);
+    if (armed) {
+      unlink(timer);
+    }
+
+    pthread_mutex_unlock(&wheelMutex_);
+
+    return armed;
+  }
+
+  int TimerWheel::advance() {
+    int result = pthread_mutex_lock(&wheelMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    unsigned long long target = now();
+    while (current_ < target) {
+      current_++;
+
+      // a lower level wrapping around pulls the next slot of the level above down
+      for (int level = 1; level < TIMER_LEVELS; level++) {
+	if ((current_ & ((1ull << (level * TIMER_SLOT_BITS)) - 1)) != 0) {
+	  break;
+	}
+	cascade(level);
+      }
+
+      Timer** slot = &slots_[0][current_ & (TIMER_SLOTS - 1)];
+      while (*slot != NULL) {
+	Timer* timer = *slot;
+	unlink(timer);
+	link(&expired_, timer);
+      }
+    }
+
+    // callbacks run unlocked so they can arm and cancel timers themselves
+    runner_ = pthread_self();
+    while (expired_ != NULL) {
+      Timer* timer = expired_;
+      unlink(timer);
+      running_ = timer;
+      pthread_mutex_unlock(&wheelMutex_);
+
+      timer->expired();
+
+      pthread_mutex_lock(&wheelMutex_);
+      running_ = NULL;
+      pthread_cond_broadcast(&wheelCond_);
+    }
+
+    return pthread_mutex_unlock(&wheelMutex_);
+  }
+
+  unsigned long long TimerWheel::now() const {
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+    return (((unsigned long long)current.tv_sec * 1000) + (current.tv_nsec / 1000000)) / TIMER_TICK;
+  }
+
+  void TimerWheel::link(Timer** list, Timer* timer) {
+    timer->next_ = *list;
+    if (timer->next_ != NULL) {
+      timer->next_->pprev_ = &timer->next_;
+    }
+    timer->pprev_ = list;
+    *list = timer;
+  }
+
+  void TimerWheel::unlink(Timer* timer) {
+    *timer->pprev_ = timer->next_;
+    if (timer->next_ != NULL) {
+      timer->next_->pprev_ = timer->pprev_;
+    }
+    timer->next_ = NULL;
+    timer->pprev_ = NULL;
+  }
+
+  void TimerWheel::insert(Timer* timer) {
+    unsigned long long delta = timer->expiry_ - current_;
+    for (int level = 0; level < TIMER_LEVELS; level++) {
+      if ((delta < (1ull << ((level + 1) * TIMER_SLOT_BITS))) || (level == (TIMER_LEVELS - 1))) {
+	if (level == (TIMER_LEVELS - 1)) {
+	  unsigned long long limit = (1ull << (TIMER_LEVELS * TIMER_SLOT_BITS)) - 1;
+	  if (delta > limit) {
+	    timer->expiry_ = current_ + limit;
+	  }
+	}
+	int slot = (int)((timer->expiry_ >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1));
+	link(&slots_[level][slot], timer);
+	return;
+      }
+    }
+  }
+
+  void TimerWheel::cascade(int level) {
+    int slot = (int)((current_ >> (level * TIMER_SLOT_BITS)) & (TIMER_SLOTS - 1));
+    Timer* timer = slots_[level][slot];
+    slots_[level][slot] = NULL;
+    while (timer != NULL) {
+      Timer* next = timer->next_;
+      timer->next_ = NULL;
+      timer->pprev_ = NULL;
+      if (timer->expiry_ <= current_) {
+	link(&expired_, timer);
+      }
+      else {
+	insert(timer);
+      }
+      timer = next;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+/*********************************************************************/
+/* timer                                                             */
+/*********************************************************************/
+
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include <pthread.h>
+
+namespace XB {
+
+  const long TIMER_TICK = 10;  // ms
+  const int TIMER_LEVELS = 4;
+  const int TIMER_SLOT_BITS = 6;
+  const int TIMER_SLOTS = 1 << TIMER_SLOT_BITS;  // 64 slots per level, ~46h at the top level
+
+  class TimerWheel;
+
+  // armed on a TimerWheel; expired() runs on the thread advancing the wheel and must not block
+  class Timer {
+  public:
+    Timer();
+    virtual ~Timer();
+    bool isArmed() const;
+
+  protected:
+    virtual void expired() = 0;
+
+  private:
+    friend class TimerWheel;
+    Timer* next_;
+    Timer** pprev_;  // the pointer pointing at this timer, NULL when not armed
+    unsigned long long expiry_;  // in ticks
+  };
+
+  // hierarchical hashed timing wheel: O(1) arm and cancel, expiry cascades slots down a level at a time
+  class TimerWheel {
+  public:
+    TimerWheel();
+    ~TimerWheel();
+    int initialize();
+    int destroy();
+    int arm(Timer* timer, long delay);
+    bool cancel(Timer* timer);
+    int advance();
+
+  private:
+    unsigned long long now() const;
+    void link(Timer** list, Timer* timer);
+    void unlink(Timer* timer);
+    void insert(Timer* timer);
+    void cascade(int level);
+
+  private:
+    Timer* slots_[TIMER_LEVELS][TIMER_SLOTS];
+    Timer* expired_;
+    unsigned long long current_;
+    Timer* running_;
+    pthread_t runner_;
+    pthread_mutex_t wheelMutex_;
+    pthread_cond_t wheelCond_;
+  };
+}
+
+#endif // _TIMER_H_
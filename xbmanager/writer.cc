@@ -0,0 +1,337 @@
+/*********************************************************************/
+/* writer                                                            */
+/*********************************************************************/
+
+#include "writer.h"
+
+#include "../xbserial/log.h"
+
+namespace XB {
+
+  static long between(const struct timespec& start, const struct timespec& end) {
+    return (1000 * (long)(end.tv_sec - start.tv_sec)) + ((end.tv_nsec - start.tv_nsec) / 1000000);
+  }
+
+  FrameWriter::FrameWriter() {
+    serial_ = NULL;
+    pacingWindow_ = DEFAULT_PACING_WINDOW;
+    for (int priority = 0; priority < PRIORITY_COUNT; priority++) {
+      Lane& lane = lanes_[priority];
+      lane.stub.next = NULL;
+      lane.head = &lane.stub;
+      lane.tail = &lane.stub;
+      lane.staged = NULL;
+      lane.depth = 0;
+      lane.sent = 0;
+      lane.totalWait = 0;
+      lane.maxWait = 0;
+    }
+    stopping_.store(false);
+  }
+
+  FrameWriter::~FrameWriter() {
+  }
+
+  int FrameWriter::initialize(Serial* serial) {
+    serial_ = serial;
+
+    int result = pthread_mutex_init(&statisticsMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_init(&pacingMutex_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_cond_init(&pacingCond_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = sem_init(&ready_, 0, 0);
+    if (result != 0) {
+      return result;
+    }
+
+    return pthread_create(&writerThread_, NULL, &FrameWriter::monitor_, this);
+  }
+
+  // writes out whatever is already queued before returning; nothing may send meanwhile
+  int FrameWriter::destroy() {
+    stopping_.store(true);
+    sem_post(&ready_);
+
+    int result = pthread_join(writerThread_, NULL);
+    if (result != 0) {
+      return result;
+    }
+
+    result = sem_destroy(&ready_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_cond_destroy(&pacingCond_);
+    if (result != 0) {
+      return result;
+    }
+
+    result = pthread_mutex_destroy(&pacingMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    return pthread_mutex_destroy(&statisticsMutex_);
+  }
+
+  // 0 once the frame is queued, write errors are only logged
+  int FrameWriter::send(const Frame& frame, Priority priority) {
+    Node* node = new Node();
+    node->next = NULL;
+    int result = ((Frame&)frame).encode(&node->data);
+    if (result != 0) {
+      delete node;
+      return result;
+    }
+
+    return enqueue(node, priority);
+  }
+
+  // an already encoded frame, see RemoteCommandTemplate; its bytes are taken and encoded left empty
+  int FrameWriter::send(Buffer* encoded, Priority priority) {
+    Node* node = new Node();
+    node->next = NULL;
+    node->data.swap(*encoded);
+
+    return enqueue(node, priority);
+  }
+
+  int FrameWriter::enqueue(Node* node, Priority priority) {
+    clock_gettime(CLOCK_MONOTONIC, &node->queued);
+
+    Lane* lane = &lanes_[priority];
+    __sync_add_and_fetch(&lane->depth, 1);
+    push(lane, node);
+
+    return sem_post(&ready_);
+  }
+
+  int FrameWriter::getStatistics(Priority priority, LaneStatistics* statistics) {
+    int result = pthread_mutex_lock(&statisticsMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    Lane& lane = lanes_[priority];
+    statistics->depth = __sync_fetch_and_add(&lane.depth, 0);
+    statistics->sent = lane.sent;
+    statistics->averageWait = (lane.sent > 0) ? (lane.totalWait / (long)lane.sent) : 0;
+    statistics->maxWait = lane.maxWait;
+
+    return pthread_mutex_unlock(&statisticsMutex_);
+  }
+
+  // 0 turns pacing off
+  void FrameWriter::setPacingWindow(std::size_t window) {
+    if (pthread_mutex_lock(&pacingMutex_) != 0) {
+      return;
+    }
+
+    pacingWindow_ = window;
+    pthread_cond_signal(&pacingCond_);
+
+    pthread_mutex_unlock(&pacingMutex_);
+  }
+
+  std::size_t FrameWriter::getPacingWindow() {
+    if (pthread_mutex_lock(&pacingMutex_) != 0) {
+      return 0;
+    }
+
+    std::size_t window = pacingWindow_;
+
+    pthread_mutex_unlock(&pacingMutex_);
+
+    return window;
+  }
+
+  // bytes written but not yet shifted out to the radio, including those held back while it
+  // deasserts CTS or has sent XOFF; nothing is counted once it has left the port
+  std::size_t FrameWriter::outputPending() {
+    int pending = serial_->getOutputPending();
+    return (pending > 0) ? (std::size_t)pending : 0;
+  }
+
+  void FrameWriter::waitForRoom() {
+    if (pthread_mutex_lock(&pacingMutex_) != 0) {
+      return;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += PACING_POLL * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&pacingCond_, &pacingMutex_, &deadline);
+
+    pthread_mutex_unlock(&pacingMutex_);
+  }
+
+  // Vyukov's intrusive queue: one exchange per push, no locks and no retries
+  void FrameWriter::push(Lane* lane, Node* node) {
+    Node* previous = __sync_lock_test_and_set(&lane->head, node);
+    __sync_synchronize();
+    previous->next = node;
+  }
+
+  // NULL when empty, or while a push is between its exchange and its link
+  FrameWriter::Node* FrameWriter::pop(Lane* lane) {
+    Node* tail = lane->tail;
+    Node* next = (Node*)__sync_fetch_and_add(&tail->next, 0);
+    if (tail == &lane->stub) {
+      if (next == NULL) {
+	return NULL;
+      }
+      lane->tail = next;
+      tail = next;
+      next = (Node*)__sync_fetch_and_add(&tail->next, 0);
+    }
+
+    if (next != NULL) {
+      lane->tail = next;
+      return tail;
+    }
+
+    if (tail != __sync_fetch_and_add(&lane->head, 0)) {
+      return NULL;
+    }
+
+    // tail is the last node, put the stub behind it so it can be taken
+    lane->stub.next = NULL;
+    push(lane, &lane->stub);
+    next = (Node*)__sync_fetch_and_add(&tail->next, 0);
+    if (next != NULL) {
+      lane->tail = next;
+      return tail;
+    }
+
+    return NULL;
+  }
+
+  // strict priority, except that every PRIORITY_AGING waited raises a frame one priority, past
+  // urgent if need be, so bulk traffic is not starved by a steady stream of urgent frames;
+  // between equal priorities the frame queued first goes first
+  FrameWriter::Lane* FrameWriter::next(const struct timespec& now) {
+    Lane* best = NULL;
+    long bestPriority = 0;
+    long bestWait = 0;
+    for (int priority = 0; priority < PRIORITY_COUNT; priority++) {
+      Lane* lane = &lanes_[priority];
+      if (lane->staged == NULL) {
+	lane->staged = pop(lane);
+	if (lane->staged == NULL) {
+	  continue;
+	}
+      }
+
+      long wait = between(lane->staged->queued, now);
+      long effective = priority - (wait / PRIORITY_AGING);
+      if ((best == NULL) || (effective < bestPriority) || ((effective == bestPriority) && (wait > bestWait))) {
+	best = lane;
+	bestPriority = effective;
+	bestWait = wait;
+      }
+    }
+
+    return best;
+  }
+
+  void* FrameWriter::monitor_(void* context) {
+    return ((FrameWriter*)context)->monitor();
+  }
+
+  void* FrameWriter::monitor() {
+    Buffer batch;
+    batch.reserve(WRITE_BATCH_SIZE);
+    while (true) {
+      if (sem_wait(&ready_) != 0) {
+	continue;
+      }
+
+      // everything ready goes out in one write; the first node taken accounts for the wakeup
+      // and each further one for its own post, so a later wakeup may find nothing to do
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+
+      bool first = true;
+      bool staged = false;
+      while (true) {
+	std::size_t window = getPacingWindow();
+	std::size_t used = (window > 0) ? outputPending() : 0;
+	bool paced = false;
+
+	Lane* lane;
+	while ((lane = next(now)) != NULL) {
+	  Node* node = lane->staged;
+	  if (!batch.empty() && ((batch.size() + node->data.size()) > WRITE_BATCH_SIZE)) {
+	    staged = true;  // its post is still outstanding
+	    break;
+	  }
+
+	  // never more than the window waiting in the driver, though an oversized frame may go alone
+	  if ((window > 0) && ((used + batch.size() + node->data.size()) > window) && ((used > 0) || !batch.empty())) {
+	    paced = true;
+	    break;
+	  }
+
+	  if (!first) {
+	    sem_trywait(&ready_);
+	  }
+	  first = false;
+	  lane->staged = NULL;
+
+	  long wait = between(node->queued, now);
+	  if (pthread_mutex_lock(&statisticsMutex_) == 0) {
+	    lane->sent++;
+	    lane->totalWait += wait;
+	    if (wait > lane->maxWait) {
+	      lane->maxWait = wait;
+	    }
+	    pthread_mutex_unlock(&statisticsMutex_);
+	  }
+	  __sync_sub_and_fetch(&lane->depth, 1);
+
+	  batch.insert(batch.end(), node->data.begin(), node->data.end());
+	  delete node;
+	}
+
+	if (!batch.empty()) {
+	  int result = serial_->write(batch);
+	  if (result != 0) {
+	    logError(result, "Failed to write %u bytes", (unsigned int)batch.size());
+	  }
+	  batch.clear();
+	}
+
+	if (!paced) {
+	  break;
+	}
+
+	// frames that arrive meanwhile are still picked by priority once there is room
+	waitForRoom();
+	clock_gettime(CLOCK_MONOTONIC, &now);
+      }
+
+      // senders have stopped by now, so an empty queue stays empty
+      if (stopping_.load() && !staged) {
+	break;
+      }
+    }
+
+    return NULL;
+  }
+}
@@ -0,0 +1,100 @@
+/*********************************************************************/
+/* writer                                                            */
+/*********************************************************************/
+
+#ifndef _WRITER_H_
+#define _WRITER_H_
+
+#include <atomic>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "../xbserial/serial.h"
+
+namespace XB {
+
+  const std::size_t WRITE_BATCH_SIZE = 1024;  // bytes coalesced into one write
+
+  enum Priority {
+    PRIORITY_URGENT,  // actuation
+    PRIORITY_INTERACTIVE,  // queries someone is waiting on
+    PRIORITY_BULK,  // configuration sweeps and data transfers
+    PRIORITY_COUNT
+  };
+
+  const long PRIORITY_AGING = 250;  // ms of waiting that raise a frame one priority
+
+  const std::size_t DEFAULT_PACING_WINDOW = 200;  // bytes, about the radio's serial receive buffer
+  const long PACING_POLL = 10;  // ms between looks at the driver's output queue
+
+  struct LaneStatistics {
+    std::size_t depth;  // frames queued now
+    unsigned long sent;
+    long averageWait;  // ms
+    long maxWait;  // ms
+
+    LaneStatistics() {
+      depth = 0;
+      sent = 0;
+      averageWait = 0;
+      maxWait = 0;
+    }
+  };
+
+  // the only thread writing to the serial port; frames are encoded on the sending thread
+  // and handed over through one lock-free multi-producer, single-consumer queue per priority
+  class FrameWriter {
+  public:
+    FrameWriter();
+    ~FrameWriter();
+    int initialize(Serial* serial);
+    int destroy();
+    int send(const Frame& frame, Priority priority = PRIORITY_INTERACTIVE);
+    int send(Buffer* encoded, Priority priority = PRIORITY_INTERACTIVE);
+    int getStatistics(Priority priority, LaneStatistics* statistics);
+    void setPacingWindow(std::size_t window);
+
+  private:
+    struct Node {
+      Buffer data;
+      struct timespec queued;
+      Node* next;
+    };
+
+    struct Lane {
+      Node stub;
+      Node* head;  // the last node pushed, swapped in by producers
+      Node* tail;  // the next node to pop, owned by the writer thread
+      Node* staged;  // popped, waiting for its turn
+      int depth;
+      unsigned long sent;
+      long totalWait;
+      long maxWait;
+    };
+
+  private:
+    int enqueue(Node* node, Priority priority);
+    void push(Lane* lane, Node* node);
+    Node* pop(Lane* lane);
+    Lane* next(const struct timespec& now);
+    std::size_t getPacingWindow();
+    std::size_t outputPending();
+    void waitForRoom();
+    static void* monitor_(void* context);
+    void* monitor();
+
+  private:
+    Serial* serial_;
+    Lane lanes_[PRIORITY_COUNT];
+    sem_t ready_;  // posted once per node pushed
+    std::atomic<bool> stopping_;
+    pthread_t writerThread_;
+    pthread_mutex_t statisticsMutex_;
+    std::size_t pacingWindow_;
+    pthread_mutex_t pacingMutex_;
+    pthread_cond_t pacingCond_;
+  };
+}
+
+#endif // _WRITER_H_
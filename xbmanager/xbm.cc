@@ -5,8 +5,10 @@
 #include "xbm.h"
 
 #include <vector>
+#include <set>
 #include <iostream>
 #include <string>
+#include <pthread.h>
 
 #include "../xbserial/frame.h"
 #include "../xbserial/log.h"
@@ -17,6 +19,99 @@ int monitorCallback(XB::Frame *frame) {
   return 0;
 }
 
+// the main loop, revalidation and joins may all come across the same module,
+// only the first to get to it configures it
+class ModuleConfigurator {
+public:
+  ModuleConfigurator(XB::Manager& manager, XB::ModuleConfiguration* configuration) : manager_(manager) {
+    configuration_ = configuration;
+    pthread_mutex_init(&configuringMutex_, NULL);
+  }
+
+  ~ModuleConfigurator() {
+    pthread_mutex_destroy(&configuringMutex_);
+  }
+
+  void configure(XB::Module* module) {
+    using namespace XB;
+
+    // named modules are left as they are, but still watched so they can go stale
+    if (module->identifier.find_first_not_of(' ') != std::string::npos) {
+      long interval = configuration_->reportingInterval();
+      if (interval > 0) {
+	manager_.setExpectedInterval(module, interval);
+      }
+      return;
+    }
+
+    pthread_mutex_lock(&configuringMutex_);
+    bool configuring = !configuring_.insert(module->address64).second;
+    pthread_mutex_unlock(&configuringMutex_);
+    if (configuring) {
+      return;
+    }
+
+    log("Configuring module '%s'", module->identifier.c_str());
+    int result = manager_.configureModule(module, configuration_);
+    if (result != 0) {
+      logError(result, "Failed to configure module '%s'", module->identifier.c_str());
+    }
+
+    pthread_mutex_lock(&configuringMutex_);
+    configuring_.erase(module->address64);
+    pthread_mutex_unlock(&configuringMutex_);
+  }
+
+private:
+  XB::Manager& manager_;
+  XB::ModuleConfiguration* configuration_;
+  std::set<XB::Address64> configuring_;
+  pthread_mutex_t configuringMutex_;
+};
+
+// a registered module is trusted until liveness reports it stale, only then is it asked
+// for its 16-bit address again, which also refreshes the registry when it answers
+class ModuleRevalidator : public XB::ModuleEventSubscriber {
+public:
+  ModuleRevalidator(XB::Manager& manager) : manager_(manager) {
+  }
+
+  void received(XB::ModuleEvent event) {
+    using namespace XB;
+
+    if (event.type != MODULE_STALE) {
+      return;
+    }
+
+    Module module = event.module;
+    module.address16 = UNKNOWN;
+    Parameter parameter;
+    int result = manager_.getRemoteParameter(&module, Command("MY"), &parameter);
+    if (result != 0) {
+      logError(result, "Module '%s' did not answer", module.identifier.c_str());
+    }
+  }
+
+private:
+  XB::Manager& manager_;
+};
+
+// configures modules as their node identification arrives, no discovery needed
+class ModuleJoinConfigurator : public XB::ModuleEventSubscriber {
+public:
+  ModuleJoinConfigurator(ModuleConfigurator& configurator) : configurator_(configurator) {
+  }
+
+  void received(XB::ModuleEvent event) {
+    if ((event.type == XB::MODULE_JOINED) || (event.type == XB::MODULE_REJOINED)) {
+      configurator_.configure(&event.module);
+    }
+  }
+
+private:
+  ModuleConfigurator& configurator_;
+};
+
 int main (int argc, char** argv) {
   using namespace XB;
 
@@ -25,36 +120,48 @@ int main (int argc, char** argv) {
   if (result != 0) {
     return result;
   }
-  
-  std::vector<Module*> modules;
-  result = manager.discoverModules(modules);
-  if (result != 0) {
-    return result;
-  }
 
   ModuleConfiguration configuration;
-  configuration.addCommandParameter(Command("V+"), Parameter(0xFFFF));
-  configuration.addCommandParameter(Command("IR"), Parameter(0x32));
-  configuration.addCommandParameter(Command("SP"), Parameter(0xC8));
-  //configuration.addCommandParameter(Command("SN"), Parameter(0x14));
-  configuration.addCommandParameter(Command("ST"), Parameter(0x32));
+  configuration.addCommandParameter("V+", 0xFFFF);
+  configuration.addCommandParameter("IR", 0x32);
+  configuration.addCommandParameter("SP", 0xC8);
+  //configuration.addCommandParameter("SN", 0x14);
+  configuration.addCommandParameter("ST", 0x32);
 
-  for (std::vector<Module*>::iterator it = modules.begin(); it != modules.end(); it++) {
-    Module* module = *it;
-    if (module->identifier.find_first_not_of(' ') == std::string::npos) {
-      log("Configuring module '%s'", module->identifier.c_str());
-      result = manager.configureModule(module, &configuration);
-      if (result != 0) {
-	logError(result, "Failed to configure module '%s'", module->identifier.c_str());
-      }
+  // IR above is only the starting rate, each module's then follows its inputs
+  SamplingPolicy policy;
+  policy.initialInterval = 0x32;
+  SamplingController samplingController(manager, policy);
+  manager.subscribeIOSample(&samplingController);
+
+  // start from the registry when there is one, discovery only runs on an empty registry
+  // and registered modules are revalidated one by one as they go stale
+  ModuleConfigurator configurator(manager, &configuration);
+  ModuleJoinConfigurator joinConfigurator(configurator);
+  manager.subscribeModuleEvent(&joinConfigurator);
+  ModuleRevalidator revalidator(manager);
+  manager.subscribeModuleEvent(&revalidator);
+
+  std::vector<Module*> modules;
+  if ((manager.loadRegistry() != 0) || (manager.getRegisteredModules(modules) != 0) || modules.empty()) {
+    result = manager.discoverModules(modules);
+    if (result != 0) {
+      return result;
     }
   }
 
+  for (std::vector<Module*>::iterator it = modules.begin(); it != modules.end(); it++) {
+    configurator.configure(*it);
+  }
+
   for (std::string line; std::getline(std::cin, line);) {
     if (line.compare("q") == 0) {
       break;
     }
   }
 
+  manager.saveRegistry();
+  manager.destroy();
+
   return 0;
 }
@@ -6,5 +6,6 @@
 #define _XBM_H_
 
 #include "manager.h"
+#include "sampling.h"
 
 #endif  // _XBM_H_
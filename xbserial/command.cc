@@ -4,6 +4,8 @@
 
 #include "command.h"
 
+#include <utility>
+
 #include "log.h"
 
 namespace XB {
@@ -38,7 +40,7 @@ namespace XB {
   }
 
   unsigned short CommandFrame::getPayloadLength() {
-    return sizeof(id_) + sizeof(command_) + parameter_.length + Frame::getPayloadLength();
+    return sizeof(id_) + Fields::size + parameter_.length + Frame::getPayloadLength();
   }
 
   int CommandFrame::writePayloadPrologue(int fd) {
@@ -60,7 +62,7 @@ namespace XB {
   }
 
   int CommandFrame::writePayload(int fd) {
-    int result = writeAccumulate(fd, (byte*)&command_, sizeof(command_));
+    int result = writeLayout<Fields>(fd, this);
     if (result != 0) {
       return result;
     }
@@ -85,6 +87,16 @@ namespace XB {
   }
 
 
+  QueuedCommandFrame::QueuedCommandFrame(Command command, byte id) : CommandFrame(TYPE_COMMAND_QUEUE, command, id) {
+  }
+
+  QueuedCommandFrame::QueuedCommandFrame(Command command, Parameter parameter, byte id) : CommandFrame(TYPE_COMMAND_QUEUE, command, parameter, id) {
+  }
+
+  QueuedCommandFrame::~QueuedCommandFrame() {
+  }
+
+
   CommandResponseFrame::CommandResponseFrame(byte type) : Frame(type) {
 }
 
@@ -92,9 +104,6 @@ namespace XB {
   }
 
   CommandResponseFrame::~CommandResponseFrame() {
-    if ((parameter_.data != NULL) && (parameter_.data != (byte*)&parameter_.value)) {
-      delete [] parameter_.data;
-    }
   }
 
   byte CommandResponseFrame::getId() const {
@@ -109,15 +118,12 @@ namespace XB {
     return status_;
   }
 
-  Parameter CommandResponseFrame::getParameter() const {
+  const Parameter& CommandResponseFrame::getParameter() const {
     return parameter_;
   }
 
   Parameter CommandResponseFrame::detachParameter() {
-    Parameter parameter = parameter_;
-    parameter_.data = NULL;
-    parameter_.length = 0;
-    return parameter;
+    return std::move(parameter_);
   }
 
   unsigned short CommandResponseFrame::getPayloadPrologueLength() {
@@ -138,23 +144,17 @@ namespace XB {
   }
 
   int CommandResponseFrame::readPayload(int fd, unsigned short length) {
-    int result = readAccumulate(fd, (byte*)&command_, sizeof(command_));
+    int result = readLayout<Fields>(fd, this);
     if (result != 0) {
       return result;
     }
 
     if (DEBUG_FRAMES) {
-      _log(" %s", command_.std_string().c_str());
-    }
-    
-    result = readAccumulate(fd, &status_);
-    if (result != 0) {
-      return result;
+      _log(" %s %02X", command_.std_string().c_str(), status_);
     }
     
-    parameter_.length = length - sizeof(command_) - 1;
+    parameter_.resize((length > Fields::size) ? length - Fields::size : 0);
     if (parameter_.length > 0) {
-      parameter_.data = new byte[parameter_.length];
       result = readAccumulate(fd, parameter_.data, parameter_.length);
       if (result != 0) {
 	return result;
@@ -186,7 +186,7 @@ namespace XB {
   }
 
   unsigned short RemoteCommandFrame::getPayloadLength() {
-    return sizeof(address64_) + sizeof(address16_) + sizeof(options_) + CommandFrame::getPayloadLength();
+    return Fields::size + CommandFrame::getPayloadLength();
   }
 
   RemoteCommandFrame* RemoteCommandFrame::toCoordinator(Command command, byte id) {
@@ -214,7 +214,7 @@ namespace XB {
   }
   
   int RemoteCommandFrame::writePayload(int fd) {
-    int result = writeAccumulate(fd, (byte*)&address64_, sizeof(address64_));
+    int result = writeLayout<Fields>(fd, this);
     if (result != 0) {
       return result;
     }
@@ -222,27 +222,77 @@ namespace XB {
     if (DEBUG_FRAMES) {
       _log(" @");
       _logData((byte*)&address64_, sizeof(address64_));
-    }
-    
-    result = writeAccumulate(fd, (byte*)&address16_, sizeof(address16_));
-    if (result != 0) {
-      return result;
-    }
-
-    if (DEBUG_FRAMES) {
       _log(",@");
       _logData((byte*)&address16_, sizeof(address16_));
     }
-    
-    result = writeAccumulate(fd, &options_);
-    if (result != 0) {
-      return result;
-    }
 
     return CommandFrame::writePayload(fd);
   }
 
 
+  RemoteCommandTemplate::RemoteCommandTemplate(Address64 address64, Address16 address16, byte options, Command command) {
+    address64_ = address64;
+    address16_ = address16;
+    options_ = options;
+    command_ = command;
+    compile();
+  }
+
+  Address64 RemoteCommandTemplate::getAddress64() const {
+    return address64_;
+  }
+
+  Address16 RemoteCommandTemplate::getAddress16() const {
+    return address16_;
+  }
+
+  Command RemoteCommandTemplate::getCommand() const {
+    return command_;
+  }
+
+  // a new route only costs recompiling when the address actually changed
+  void RemoteCommandTemplate::setAddress16(Address16 address16) {
+    if (address16 != address16_) {
+      address16_ = address16;
+      compile();
+    }
+  }
+
+  void RemoteCommandTemplate::compile() {
+    byte fields[Fields::size];
+    Fields::encode(this, fields);
+
+    sum_ = TYPE_REMOTE_COMMAND;
+    for (std::size_t index = 0; index < sizeof(fields); index++) {
+      sum_ += fields[index];
+    }
+
+    fields_.clear();
+    bufwrite(&fields_, fields, sizeof(fields));
+  }
+
+  // appends the same bytes as RemoteCommandFrame(...).encode, the frame id sits between the type and the fields
+  void RemoteCommandTemplate::encode(byte id, const Parameter& parameter, Buffer* buffer) const {
+    unsigned short length = 2 + Fields::size + parameter.length;  // type, id, fields
+    byte header[] = { (byte)(length >> 8), (byte)length };
+
+    buffer->reserve(buffer->size() + 4 + fields_.size() + 2 * (2 + parameter.length + 2));
+    buffer->push_back(START_DELIMITER);
+    bufwrite(buffer, header, sizeof(header));
+    buffer->push_back(TYPE_REMOTE_COMMAND);
+    bufwrite(buffer, &id);
+    _bufwrite(buffer, &fields_[0], fields_.size());
+    bufwrite(buffer, parameter.data, parameter.length);
+
+    byte sum = sum_ + id;
+    for (unsigned short index = 0; index < parameter.length; index++) {
+      sum += parameter.data[index];
+    }
+    byte checksum = 0xFF - sum;
+    bufwrite(buffer, &checksum);
+  }
+
+
   RemoteCommandResponseFrame::RemoteCommandResponseFrame(byte type) : CommandResponseFrame(type) {
   }
 
@@ -261,7 +311,7 @@ namespace XB {
   }
 
   int RemoteCommandResponseFrame::readPayload(int fd, unsigned short length) {
-    int result = readAccumulate(fd, (byte*)&address64_, sizeof(address64_));
+    int result = readLayout<Fields>(fd, this);
     if (result != 0) {
       return result;
     }
@@ -269,19 +319,11 @@ namespace XB {
     if (DEBUG_FRAMES) {
       _log(" @");
       _logData((byte*)&address64_, sizeof(address64_));
-    }
-    
-    result = readAccumulate(fd, (byte*)&address16_, sizeof(address16_));
-    if (result != 0) {
-      return result;
-    }
-
-    if (DEBUG_FRAMES) {
       _log(",@");
       _logData((byte*)&address16_, sizeof(address16_));
     }
-    
-    length -= sizeof(address64_) + sizeof(address16_);
+
+    length -= Fields::size;
     return CommandResponseFrame::readPayload(fd, length);
   }
 
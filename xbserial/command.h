@@ -5,6 +5,10 @@
 #ifndef _COMMAND_H_
 #define _COMMAND_H_
 
+#include <functional>
+#include <stdint.h>
+#include <endian.h>
+
 #include "frame.h"
 
 namespace XB {
@@ -39,33 +43,86 @@ namespace XB {
     unsigned short ushort() const {
       return ntohs((unsigned short)a | ((unsigned short)b << 8));
     }
+
+    friend bool operator ==(const _2Byte& l, const _2Byte& r) {
+      return (l.a == r.a) && (l.b == r.b);
+    }
+
+    friend bool operator !=(const _2Byte& l, const _2Byte& r) {
+      return !(l == r);
+    }
   };
 
   typedef _2Byte Command;
   
+  const unsigned short PARAMETER_INLINE_SIZE = 20;  // covers all but the longest AT values (NI, ND)
+
+  // owns its bytes, inline up to PARAMETER_INLINE_SIZE and on the heap beyond; copies are deep
+  // and moves take over the heap buffer, so parameters can be passed around by value
   struct Parameter {
     byte* data;
     unsigned short length;
-    unsigned short value;
 
     Parameter() {
-      data = NULL;
+      data = inline_;
       length = 0;
     }
 
     Parameter(unsigned short value) {
-      this->value = htons(value);
-      data = (byte*)&this->value;
+      data = inline_;
       length = 2;
+      data[0] = (byte)(value >> 8);
+      data[1] = (byte)value;
     }
 
     Parameter(const char* parameter) {
-      data = (byte*)parameter;
-      length = strlen(parameter);
+      data = inline_;
+      length = 0;
+      assign((const byte*)parameter, strlen(parameter));
+    }
+
+    Parameter(const byte* data, unsigned short length) {
+      this->data = inline_;
+      this->length = 0;
+      assign(data, length);
+    }
+
+    Parameter(const Parameter& parameter) {
+      data = inline_;
+      length = 0;
+      assign(parameter.data, parameter.length);
+    }
+
+    Parameter(Parameter&& parameter) {
+      data = inline_;
+      length = 0;
+      take(parameter);
+    }
+
+    ~Parameter() {
+      release();
+    }
+
+    Parameter& operator =(const Parameter& parameter) {
+      if (this != &parameter) {
+	assign(parameter.data, parameter.length);
+      }
+      return *this;
+    }
+
+    Parameter& operator =(Parameter&& parameter) {
+      if (this != &parameter) {
+	take(parameter);
+      }
+      return *this;
     }
 
-    Parameter(byte* data, unsigned short length) {
-      this->data = data;
+    // length bytes of undefined content, for reading into
+    void resize(unsigned short length) {
+      release();
+      if (length > PARAMETER_INLINE_SIZE) {
+	data = new byte[length];
+      }
       this->length = length;
     }
 
@@ -76,6 +133,38 @@ namespace XB {
     unsigned short ushort() const {
       return ntohs((unsigned short)data[0] | ((unsigned short)data[1] << 8));
     }
+
+  private:
+    void assign(const byte* data, unsigned short length) {
+      resize(length);
+      if (length > 0) {
+	memmove(this->data, data, length);
+      }
+    }
+
+    void take(Parameter& parameter) {
+      if (parameter.data == parameter.inline_) {
+	assign(parameter.data, parameter.length);
+      }
+      else {
+	release();
+	data = parameter.data;
+	length = parameter.length;
+	parameter.data = parameter.inline_;
+      }
+      parameter.length = 0;
+    }
+
+    void release() {
+      if (data != inline_) {
+	delete [] data;
+	data = inline_;
+      }
+      length = 0;
+    }
+
+  private:
+    byte inline_[PARAMETER_INLINE_SIZE];
   };
   
   class CommandFrame : public Frame {
@@ -96,6 +185,18 @@ namespace XB {
     byte id_;
     Command command_;
     Parameter parameter_;
+
+  private:
+    typedef Layout<Field<&CommandFrame::command_> > Fields;
+  };
+
+
+  // parameter value held by the module until applied (AC or a TYPE_COMMAND frame)
+  class QueuedCommandFrame : public CommandFrame {
+  public:
+    QueuedCommandFrame(Command command, byte id = 0);
+    QueuedCommandFrame(Command command, Parameter parameter, byte id = 0);
+    virtual ~QueuedCommandFrame();
   };
 
 
@@ -107,7 +208,7 @@ namespace XB {
     byte getId() const;
     Command getCommand() const;
     virtual byte getStatus() const;
-    Parameter getParameter() const;
+    const Parameter& getParameter() const;
     Parameter detachParameter();
     
   protected:
@@ -120,6 +221,10 @@ namespace XB {
     Command command_;
     byte status_;
     Parameter parameter_;
+
+  private:
+    typedef Layout<Field<&CommandResponseFrame::command_>,
+      Field<&CommandResponseFrame::status_> > Fields;
   };
 
 
@@ -170,15 +275,23 @@ namespace XB {
       data[7] = h;
     }
     
+    // the address as one big-endian integer, so comparisons are single word compares
+    uint64_t ulong() const {
+      uint64_t value;
+      memcpy(&value, &a, sizeof(value));
+      return be64toh(value);
+    }
+
     friend bool operator <(const _8Byte& l, const _8Byte& r) {
-      return (l.a < r.a) ||
-	((l.a == r.a) && (l.b < r.b)) ||
-	((l.a == r.a) && (l.b == r.b) && (l.c < r.c)) ||
-	((l.a == r.a) && (l.b == r.b) && (l.c == r.c) && (l.d < r.d)) ||
-	((l.a == r.a) && (l.b == r.b) && (l.c == r.c) && (l.d == r.d) && (l.e < r.e)) ||
-	((l.a == r.a) && (l.b == r.b) && (l.c == r.c) && (l.d == r.d) && (l.e == r.e) && (l.f < r.f)) ||
-	((l.a == r.a) && (l.b == r.b) && (l.c == r.c) && (l.d == r.d) && (l.e == r.e) && (l.f == r.f) && (l.g < r.g)) ||
-	((l.a == r.a) && (l.b == r.b) && (l.c == r.c) && (l.d == r.d) && (l.e == r.e) && (l.f == r.f) && (l.g == r.g) && (l.h < r.h));
+      return l.ulong() < r.ulong();
+    }
+
+    friend bool operator ==(const _8Byte& l, const _8Byte& r) {
+      return memcmp(&l.a, &r.a, sizeof(l)) == 0;
+    }
+
+    friend bool operator !=(const _8Byte& l, const _8Byte& r) {
+      return !(l == r);
     }
   };
 
@@ -194,14 +307,17 @@ namespace XB {
     Address64 address64;
     Address16 address16;
     std::string identifier;
+    unsigned long fingerprint;  // of the last configuration applied, 0 if unknown
 
     Module() {
+      fingerprint = 0;
     }
     
     Module(Address64 address64, Address16 address16, std::string identifier) {
       this->address64 = address64;
       this->address16 = address16;
       this->identifier = identifier;
+      fingerprint = 0;
     }
   };
 
@@ -231,6 +347,41 @@ namespace XB {
     Address64 address64_;
     Address16 address16_;
     byte options_;
+
+  private:
+    typedef Layout<Field<&RemoteCommandFrame::address64_>,
+      Field<&RemoteCommandFrame::address16_>,
+      Field<&RemoteCommandFrame::options_> > Fields;
+  };
+
+
+  // a RemoteCommandFrame encoded once for a destination, options and command; each encode only
+  // escapes the frame id and parameter and adds them to the checksum of the fixed fields
+  class RemoteCommandTemplate {
+  public:
+    RemoteCommandTemplate(Address64 address64, Address16 address16, byte options, Command command);
+    Address64 getAddress64() const;
+    Address16 getAddress16() const;
+    Command getCommand() const;
+    void setAddress16(Address16 address16);
+    void encode(byte id, const Parameter& parameter, Buffer* buffer) const;
+
+  private:
+    void compile();
+
+  private:
+    Address64 address64_;
+    Address16 address16_;
+    byte options_;
+    Command command_;
+    Buffer fields_;  // addresses, options and command, escaped
+    byte sum_;  // of the type and the fields
+
+  private:
+    typedef Layout<Field<&RemoteCommandTemplate::address64_>,
+      Field<&RemoteCommandTemplate::address16_>,
+      Field<&RemoteCommandTemplate::options_>,
+      Field<&RemoteCommandTemplate::command_> > Fields;
   };
 
 
@@ -248,8 +399,26 @@ namespace XB {
   private:
     Address64 address64_;
     Address16 address16_;
+
+  private:
+    typedef Layout<Field<&RemoteCommandResponseFrame::address64_>,
+      Field<&RemoteCommandResponseFrame::address16_> > Fields;
   };
 
 }
 
+namespace std {
+
+  template<>
+    struct hash<XB::_8Byte> {
+    // splitmix64 finalizer, the low (serial number) bytes vary most between modules
+    std::size_t operator()(const XB::_8Byte& address) const {
+      uint64_t value = address.ulong();
+      value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+      value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+      return (std::size_t)(value ^ (value >> 31));
+    }
+  };
+}
+
 #endif  // _COMMAND_H
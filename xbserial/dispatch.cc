@@ -0,0 +1,125 @@
+/***********************************************************/
+/* dispatch                                                */
+/***********************************************************/
+
+#include "dispatch.h"
+
+#include "command.h"
+#include "iosample.h"
+#include "node.h"
+#include "route.h"
+#include "transmit.h"
+
+namespace XB {
+
+  FrameDispatcher::FrameDispatcher() {
+    for (int type = 0; type < 256; type++) {
+      defaults_[type] = NULL;
+    }
+    defaults_[TYPE_COMMAND_RESPONSE] = decodeFrame<CommandResponseFrame>;
+    defaults_[TYPE_REMOTE_COMMAND_RESPONSE] = decodeFrame<RemoteCommandResponseFrame>;
+    defaults_[TYPE_IO_SAMPLE] = decodeFrame<IOSampleFrame>;
+    defaults_[TYPE_NODE_IDENTIFICATION] = decodeFrame<NodeIdentificationFrame>;
+    defaults_[TYPE_ROUTE_RECORD] = decodeFrame<RouteRecordFrame>;
+    defaults_[TYPE_TRANSMIT_STATUS] = decodeFrame<TransmitStatusFrame>;
+    defaults_[TYPE_RECEIVE_PACKET] = decodeFrame<ReceivePacketFrame>;
+    defaults_[TYPE_EXPLICIT_RECEIVE] = decodeFrame<ExplicitReceiveFrame>;
+
+    for (int type = 0; type < 256; type++) {
+      routes_[type] = new FrameRoute();
+      routes_[type]->decoder = (defaults_[type] != NULL) ? defaults_[type] : decodeFrame<Frame>;
+      routes_[type]->handler = NULL;
+      routes_[type]->context = NULL;
+    }
+    retiredCount_ = 0;
+
+    pthread_mutex_init(&routesMutex_, NULL);
+  }
+
+  FrameDispatcher::~FrameDispatcher() {
+    for (int type = 0; type < 256; type++) {
+      delete routes_[type];
+    }
+    for (std::vector<FrameRoute*>::iterator it = retired_.begin(); it != retired_.end(); it++) {
+      delete *it;
+    }
+
+    pthread_mutex_destroy(&routesMutex_);
+  }
+
+  // a type has at most one handler, it has to be removed before another can be added.
+  // Without a decoder the library's is used, or a plain Frame for types it does not know
+  int FrameDispatcher::add(byte type, FrameDecoder decoder, FrameHandler handler, void* context) {
+    if (handler == NULL) {
+      return ERROR_FRAME_TYPE;
+    }
+
+    int result = pthread_mutex_lock(&routesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    if (routes_[type]->handler != NULL) {
+      pthread_mutex_unlock(&routesMutex_);
+      return ERROR_FRAME_TYPE;
+    }
+
+    FrameRoute* route = new FrameRoute();
+    route->decoder = (decoder != NULL) ? decoder : routes_[type]->decoder;
+    route->handler = handler;
+    route->context = context;
+    publish(type, route);
+
+    return pthread_mutex_unlock(&routesMutex_);
+  }
+
+  // back to the library's decoder and no handler, only by whoever added handler
+  int FrameDispatcher::remove(byte type, FrameHandler handler) {
+    if (handler == NULL) {
+      return ERROR_FRAME_TYPE;
+    }
+
+    int result = pthread_mutex_lock(&routesMutex_);
+    if (result != 0) {
+      return result;
+    }
+
+    if (routes_[type]->handler != handler) {
+      pthread_mutex_unlock(&routesMutex_);
+      return ERROR_FRAME_TYPE;
+    }
+
+    FrameRoute* route = new FrameRoute();
+    route->decoder = (defaults_[type] != NULL) ? defaults_[type] : decodeFrame<Frame>;
+    route->handler = NULL;
+    route->context = NULL;
+    publish(type, route);
+
+    return pthread_mutex_unlock(&routesMutex_);
+  }
+
+  const FrameRoute* FrameDispatcher::find(byte type) const {
+    return __sync_fetch_and_add((FrameRoute**)&routes_[type], 0);
+  }
+
+  // for the receiving thread between frames, when it holds no entry; whatever was retired before can go
+  void FrameDispatcher::reclaim() {
+    if ((__sync_fetch_and_add(&retiredCount_, 0) == 0) || (pthread_mutex_lock(&routesMutex_) != 0)) {
+      return;
+    }
+
+    for (std::vector<FrameRoute*>::iterator it = retired_.begin(); it != retired_.end(); it++) {
+      delete *it;
+    }
+    retired_.clear();
+    __sync_lock_test_and_set(&retiredCount_, 0);
+
+    pthread_mutex_unlock(&routesMutex_);
+  }
+
+  // the replaced entry may still be in use on the receiving thread, so it is only retired
+  void FrameDispatcher::publish(byte type, FrameRoute* route) {
+    retired_.push_back(__sync_lock_test_and_set(&routes_[type], route));
+    __sync_add_and_fetch(&retiredCount_, 1);
+  }
+}
@@ -0,0 +1,61 @@
+/***********************************************************/
+/* dispatch                                                */
+/***********************************************************/
+
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include <vector>
+#include <pthread.h>
+
+#include "frame.h"
+
+namespace XB {
+
+  const int ERROR_FRAME_TYPE = -44;
+
+  // a new frame of the header's type, its payload not read yet
+  typedef Frame* (*FrameDecoder)(FrameHeader* header);
+
+  // takes ownership of frame, which was made by the decoder registered with the handler
+  typedef void (*FrameHandler)(Frame* frame, void* context);
+
+  template<typename F>
+    Frame* decodeFrame(FrameHeader* header) {
+    return new F(header);
+  }
+
+  struct FrameRoute {
+    FrameDecoder decoder;
+    FrameHandler handler;  // NULL when nothing consumes the type
+    void* context;
+  };
+
+  // routes by frame type in one table lookup. The library's frame types have decoders from the start,
+  // other types are read as a plain Frame until someone registers a handler and decoder for them
+  class FrameDispatcher {
+  public:
+    FrameDispatcher();
+    ~FrameDispatcher();
+    int add(byte type, FrameDecoder decoder, FrameHandler handler, void* context = NULL);
+    int remove(byte type, FrameHandler handler);
+    const FrameRoute* find(byte type) const;
+    void reclaim();
+
+  private:
+    FrameDispatcher(const FrameDispatcher&);
+    FrameDispatcher& operator =(const FrameDispatcher&);
+    void publish(byte type, FrameRoute* route);
+
+  private:
+    // entries never change once published, so the receiving thread reads them without a lock;
+    // a frame is decoded and handled through the same entry even if the type is re-registered meanwhile
+    FrameRoute* routes_[256];
+    FrameDecoder defaults_[256];
+    std::vector<FrameRoute*> retired_;  // replaced entries, until the receiving thread reclaims them
+    int retiredCount_;
+    pthread_mutex_t routesMutex_;
+  };
+}
+
+#endif // _DISPATCH_H_
@@ -7,17 +7,34 @@
 #include <iterator>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 #include <sys/select.h>
 
 #include "log.h"
 
 const byte ESCAPABLES[] = {(byte)0x11, (byte)0x13, (byte)0x7D, (byte)0x7E};
 const int ESCAPABLES_COUNT = 4;
-const byte ESCAPE_BYTE = ((byte)0x7D);
-const byte ESCAPE_MASK = ((byte)0x20);
+
+const std::size_t READ_BUFFER_SIZE = 4096;
+const std::size_t NO_MARK = (std::size_t)-1;
+
+// input is read in as large chunks as are available and handed out from here, so the
+// parser costs no system call per field and can step back to a mark after bad data
+struct Reader {
+  int fd;
+  byte data[READ_BUFFER_SIZE];
+  std::size_t begin;  // the next byte to hand out
+  std::size_t end;
+  std::size_t mark;
+  unsigned long discarded;
+  bool hasDeadline;
+  struct timespec deadline;  // CLOCK_MONOTONIC, no read waits past it
+};
 
 int _escindex(int index, const byte* data, unsigned short length);
 int _compare(const void* a, const void* b);
+Reader* _reader(int fd);
+int _fill(Reader* reader, long timeout);
 
 int fdwrite(int fd, byte *data, unsigned short length) {
   int index = 0;
@@ -90,8 +107,26 @@ int _fdwrite(int fd, const byte *data, unsigned short length) {
   return (bytesWritten < 0) ? bytesWritten : 0;
 }
 
+// the escaping of fdwrite, into memory
+void bufwrite(Buffer* buffer, const byte* data, unsigned short length) {
+  for (unsigned short index = 0; index < length; index++) {
+    if (bsearch(&data[index], ESCAPABLES, ESCAPABLES_COUNT, sizeof(*data), _compare) != NULL) {
+      buffer->push_back(ESCAPE_BYTE);
+      buffer->push_back(data[index] ^ ESCAPE_MASK);
+    }
+    else {
+      buffer->push_back(data[index]);
+    }
+  }
+}
+
+void _bufwrite(Buffer* buffer, const byte* data, unsigned short length) {
+  buffer->insert(buffer->end(), data, data + length);
+}
+
+// unescapes in place as it reads; an escape at the end of one read masks the first byte of the next
 int fdread(int fd, byte *data, unsigned short length) {
-  bool escapeLast = false;
+  bool escaped = false;
   int index = 0;
   while (index < length) {
     int result = _fdread(fd, &data[index], length - index);    
@@ -99,63 +134,206 @@ int fdread(int fd, byte *data, unsigned short length) {
       return result;
     }
 
-    if (escapeLast) {
-      data[index] = data[index] ^ ESCAPE_MASK;
-      break;
+    int next = index;
+    for (; index < length; index++) {
+      if (escaped) {
+	data[next++] = data[index] ^ ESCAPE_MASK;
+	escaped = false;
+      }
+      else if (data[index] == ESCAPE_BYTE) {
+	escaped = true;
+      }
+      else {
+	data[next++] = data[index];
+      }
     }
+    index = next;
+  }
+
+  return 0;
+}
 
-    int alength = length;
-    for (; index < alength; index++) {
-      if (data[index] == ESCAPE_BYTE) {
-	if (index < (alength - 1)) {
-	  data[index] = data[index + 1] ^ ESCAPE_MASK;
-	  if (index < (alength - 2)) {
-	    memmove(&data[index + 1], &data[index + 2], (size_t)(alength - (index + 2)));
-	  }
-	}
-	else {
-	  escapeLast = true;
-	}
-	alength--;
+int _fdread(int fd, const byte *data, unsigned short length, long timeout) {
+  Reader* reader = _reader(fd);
+  byte* current = (byte*)data;
+  std::size_t remaining = length;
+  bool waited = false;
+  while (remaining > 0) {
+    if (reader->begin == reader->end) {
+      int result = _fill(reader, waited ? 0 : timeout);
+      if (result < 0) {
+	return result;
       }
+      waited = true;
     }
-    index = alength;
+
+    std::size_t count = std::min(remaining, reader->end - reader->begin);
+    memcpy(current, &reader->data[reader->begin], count);
+    reader->begin += count;
+    current += count;
+    remaining -= count;
   }
 
   return 0;
 }
 
-int _fdread(int fd, const byte *data, unsigned short length, long timeout) {
+// skips to the next occurrence of value, leaving it unread; skipped bytes count as discarded.
+// Whatever came before is done with, so any mark or deadline is dropped
+int fdscan(int fd, byte value, long timeout) {
+  Reader* reader = _reader(fd);
+  reader->mark = NO_MARK;
+  reader->hasDeadline = false;
+  while (true) {
+    if (reader->begin == reader->end) {
+      int result = _fill(reader, timeout);
+      if (result < 0) {
+	return result;
+      }
+    }
+
+    byte* start = &reader->data[reader->begin];
+    byte* found = (byte*)memchr(start, value, reader->end - reader->begin);
+    if (found != NULL) {
+      reader->discarded += found - start;
+      reader->begin += found - start;
+      return 0;
+    }
+
+    reader->discarded += reader->end - reader->begin;
+    reader->begin = reader->end;
+  }
+}
+
+// every read on fd fails with FD_TIMEOUT once deadline passes, NULL lifts it
+void fddeadline(int fd, const struct timespec* deadline) {
+  Reader* reader = _reader(fd);
+  reader->hasDeadline = (deadline != NULL);
+  if (deadline != NULL) {
+    reader->deadline = *deadline;
+  }
+}
+
+// remembers the read position, until fdreset
+void fdmark(int fd) {
+  Reader* reader = _reader(fd);
+  reader->mark = reader->begin;
+}
+
+// back to the mark, plus skip bytes that count as discarded
+int fdreset(int fd, unsigned short skip) {
+  Reader* reader = _reader(fd);
+  if (reader->mark == NO_MARK) {
+    return -1;
+  }
 
-  if (timeout > 0) {
+  reader->begin = std::min(reader->mark + skip, reader->end);
+  reader->discarded += reader->begin - reader->mark;
+  reader->mark = NO_MARK;
+
+  return 0;
+}
+
+unsigned long fddiscarded(int fd) {
+  return _reader(fd)->discarded;
+}
+
+// drops whatever was read ahead, for when fd is closed
+void fdforget(int fd) {
+  Reader* reader = _reader(fd);
+  reader->begin = 0;
+  reader->end = 0;
+  reader->mark = NO_MARK;
+  reader->hasDeadline = false;
+}
+
+Reader* _reader(int fd) {
+  static __thread Reader* last = NULL;
+  if ((last != NULL) && (last->fd == fd)) {
+    return last;
+  }
+
+  // readers are never freed, a closed fd's is reused by the next one with its number
+  static pthread_mutex_t readersMutex = PTHREAD_MUTEX_INITIALIZER;
+  static std::vector<Reader*> readers;
+  pthread_mutex_lock(&readersMutex);
+  Reader* reader = NULL;
+  for (std::vector<Reader*>::iterator it = readers.begin(); it != readers.end(); it++) {
+    if ((*it)->fd == fd) {
+      reader = *it;
+      break;
+    }
+  }
+  if (reader == NULL) {
+    reader = new Reader();
+    reader->fd = fd;
+    reader->begin = 0;
+    reader->end = 0;
+    reader->mark = NO_MARK;
+    reader->discarded = 0;
+    reader->hasDeadline = false;
+    readers.push_back(reader);
+  }
+  pthread_mutex_unlock(&readersMutex);
+
+  last = reader;
+  return reader;
+}
+
+// reads whatever is available, waiting up to timeout ms (or for ever) for the first byte,
+// and never past the reader's deadline
+int _fill(Reader* reader, long timeout) {
+  std::size_t keep = (reader->mark != NO_MARK) ? std::min(reader->mark, reader->begin) : reader->begin;
+  if ((reader->end == READ_BUFFER_SIZE) && (keep == 0)) {
+    // a mark this far back cannot be kept
+    reader->mark = NO_MARK;
+    keep = reader->begin;
+  }
+  if (keep > 0) {
+    memmove(reader->data, &reader->data[keep], reader->end - keep);
+    reader->begin -= keep;
+    reader->end -= keep;
+    if (reader->mark != NO_MARK) {
+      reader->mark -= keep;
+    }
+  }
+
+  long wait = timeout * 1000;  // us
+  if (reader->hasDeadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long remaining = ((long)(reader->deadline.tv_sec - now.tv_sec) * 1000000) + ((reader->deadline.tv_nsec - now.tv_nsec) / 1000);
+    if (remaining <= 0) {
+      return FD_TIMEOUT;
+    }
+    if ((wait <= 0) || (remaining < wait)) {
+      wait = remaining;
+    }
+  }
+
+  if (wait > 0) {
     fd_set set;
     FD_ZERO(&set);
-    FD_SET(fd, &set);
+    FD_SET(reader->fd, &set);
 
     struct timeval tout;
-    tout.tv_sec = 0;
-    tout.tv_usec = timeout * 1000;
+    tout.tv_sec = wait / 1000000;
+    tout.tv_usec = wait % 1000000;
 
-    int result = select(fd + 1, &set, NULL, NULL, &tout);
+    int result = select(reader->fd + 1, &set, NULL, NULL, &tout);
     if (result == -1) {
       return result;
     }
     else if (result == 0) {
-      return -2;
+      return FD_TIMEOUT;
     }
     // else data available
   }
-  
-  const byte *current = data;
-  int remaining = length;
-  int bytesRead = 0;
-  while ((bytesRead = ::read(fd, (void*)current, (size_t)(remaining * sizeof(*data)))) >= 0) {
-    remaining -= bytesRead;
-    current += bytesRead * sizeof(*data);
-    if (remaining <= 0) {
-      break;
-    }
+
+  int bytesRead = ::read(reader->fd, &reader->data[reader->end], READ_BUFFER_SIZE - reader->end);
+  if (bytesRead <= 0) {
+    return -1;
   }
+  reader->end += bytesRead;
 
-  return (bytesRead < 0) ? bytesRead : 0;
+  return 0;
 }
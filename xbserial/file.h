@@ -5,11 +5,28 @@
 #ifndef _FILE_H_
 #define _FILE_H_
 
+#include <vector>
+#include <time.h>
+
 typedef unsigned char byte;
+typedef std::vector<byte> Buffer;
+
+const byte ESCAPE_BYTE = ((byte)0x7D);
+const byte ESCAPE_MASK = ((byte)0x20);
+
+const int FD_TIMEOUT = -2;
 
 int fdwrite(int fd, byte* data, unsigned short length = 1);
 int _fdwrite(int fd, const byte* data, unsigned short length = 1);
 int fdread(int fd, byte* data, unsigned short length = 1);
+void bufwrite(Buffer* buffer, const byte* data, unsigned short length = 1);
+void _bufwrite(Buffer* buffer, const byte* data, unsigned short length = 1);
 int _fdread(int fd, const byte* data, unsigned short length = 1, long timeout = 0);
+int fdscan(int fd, byte value, long timeout = 0);
+void fddeadline(int fd, const struct timespec* deadline);
+void fdmark(int fd);
+int fdreset(int fd, unsigned short skip = 0);
+unsigned long fddiscarded(int fd);
+void fdforget(int fd);
 
 #endif // _FILE_H_
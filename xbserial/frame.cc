@@ -10,20 +10,42 @@
 
 namespace XB {
 
-  const byte START_DELIMITER = ((byte)0x7E);
-
   FrameHeader::FrameHeader() {
   }
 
-  int FrameHeader::read(int fd, long timeout) {
-    byte data = 0;
-    int result;
-    while ((result = _fdread(fd, &data, 1, timeout)) == 0) {
-      if (data == START_DELIMITER) {
-	break;
-      }
+  // when the rest of a frame that started at start must have arrived, given length bytes of payload
+  // that may all be escaped and byteTime us per byte on the line
+  static struct timespec frameDeadline(const struct timespec& start, unsigned short length, long byteTime) {
+    long duration = (FRAME_MARGIN * 1000) + (byteTime * 2 * (4 + (long)length));  // us
+    struct timespec deadline = start;
+    deadline.tv_sec += duration / 1000000;
+    deadline.tv_nsec += (duration % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
     }
-    
+
+    return deadline;
+  }
+
+  // leaves a mark at the delimiter, so a frame that turns out bad can be rescanned from the byte after it.
+  // With a byteTime the whole frame, up to the checksum, must arrive by a deadline set at its delimiter
+  int FrameHeader::read(int fd, long timeout, long byteTime) {
+    int result = fdscan(fd, START_DELIMITER, timeout);
+    if (result < 0) {
+      return result;
+    }
+
+    struct timespec start;
+    if (byteTime > 0) {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      struct timespec deadline = frameDeadline(start, getMaxLength(0), byteTime);
+      fddeadline(fd, &deadline);
+    }
+
+    fdmark(fd);
+    byte data;
+    result = _fdread(fd, &data);
     if (result < 0) {
       return result;
     }
@@ -41,7 +63,7 @@ namespace XB {
     length_ = (((unsigned short)length[0] << 8) & 0xFF00) | ((unsigned short)length[1] & 0x00FF);  
     if (length_ == 0) {
       log("Length 0");
-      return 0;
+      return ERROR_FRAME_LENGTH;
     }
     
     result = fdread(fd, &type_);
@@ -49,6 +71,16 @@ namespace XB {
       return result;
     }
 
+    if (length_ > getMaxLength(type_)) {
+      log("Length %u too long for frame type %02X", length_, type_);
+      return ERROR_FRAME_LENGTH;
+    }
+
+    if (byteTime > 0) {
+      struct timespec deadline = frameDeadline(start, length_, byteTime);
+      fddeadline(fd, &deadline);
+    }
+
     if (DEBUG_FRAMES) {
       _log(FrameHeader::getTypeCode(type_).c_str());
     }
@@ -70,11 +102,13 @@ namespace XB {
   Frame::Frame(byte type) {
     type_ = type;
     checksum_ = 0;
+    output_ = NULL;
   }
 
   Frame::Frame(FrameHeader* header) {
     type_ = header->getType();
     checksum_ = 0;
+    output_ = NULL;
 
     accumulate(&type_);
   }
@@ -105,6 +139,16 @@ namespace XB {
     return writeChecksum(fd);
   }
 
+  // the bytes write would put on the wire, appended to buffer
+  int Frame::encode(Buffer* buffer) {
+    output_ = buffer;
+    checksum_ = 0;
+    int result = write(-1);
+    output_ = NULL;
+
+    return result;
+  }
+
   int Frame::read(int fd) {
     FrameHeader header;
     int result = readHeader(fd, &header);
@@ -135,7 +179,7 @@ namespace XB {
   }
 
   int Frame::writeHeader(int fd) {
-    int result = _fdwrite(fd, &start_);
+    int result = _output(fd, &start_);
     if (result != 0) {
       return result;
     }
@@ -148,7 +192,7 @@ namespace XB {
     byte length[2];
     length[0] = (byte)((ilength >> 8) & 0xFF);
     length[1] = (byte)(ilength & 0xFF);
-    result = fdwrite(fd, length, 2);
+    result = output(fd, length, 2);
     if (result != 0) {
       return result;
     }
@@ -183,7 +227,7 @@ namespace XB {
   
   int Frame::writeChecksum(int fd) {
     byte checksum = (byte)0xFF - checksum_;
-    int result = fdwrite(fd, &checksum);
+    int result = output(fd, &checksum);
     if (result != 0) {
       return result;
     }
@@ -258,7 +302,7 @@ namespace XB {
   int Frame::writeAccumulate(int fd, byte* data, unsigned short length) {
     accumulate(data, length);
   
-    return fdwrite(fd, data, length);
+    return output(fd, data, length);
   }
 
  int Frame::readAccumulate(int fd, byte* data, unsigned short length) {
@@ -278,6 +322,33 @@ namespace XB {
     }
   }
 
+  // callers log the decoded fields
+  int Frame::writeFields(int fd, byte* data, unsigned short length) {
+    return writeAccumulate(fd, data, length);
+  }
+
+  int Frame::readFields(int fd, byte* data, unsigned short length) {
+    return readAccumulate(fd, data, length);
+  }
+
+  int Frame::output(int fd, byte* data, unsigned short length) {
+    if (output_ != NULL) {
+      bufwrite(output_, data, length);
+      return 0;
+    }
+
+    return fdwrite(fd, data, length);
+  }
+
+  int Frame::_output(int fd, byte* data, unsigned short length) {
+    if (output_ != NULL) {
+      _bufwrite(output_, data, length);
+      return 0;
+    }
+
+    return _fdwrite(fd, data, length);
+  }
+
   
   int _logData(unsigned char* data, unsigned short length) {
     int result = -1;
@@ -11,38 +11,96 @@
 #include <arpa/inet.h>
 
 #include "file.h"
+#include "layout.h"
 
 namespace XB {
 
   const bool DEBUG_FRAMES = false;
 
+  const byte START_DELIMITER = ((byte)0x7E);
+
   const byte TYPE_COMMAND = ((byte)0x08);
+  const byte TYPE_COMMAND_QUEUE = ((byte)0x09);
+  const byte TYPE_TRANSMIT_REQUEST = ((byte)0x10);
+  const byte TYPE_EXPLICIT_TRANSMIT = ((byte)0x11);
   const byte TYPE_COMMAND_RESPONSE = ((byte)0x88);
   const byte TYPE_REMOTE_COMMAND = ((byte)0x17);
+  const byte TYPE_CREATE_SOURCE_ROUTE = ((byte)0x21);
   const byte TYPE_REMOTE_COMMAND_RESPONSE = ((byte)0x97);
+  const byte TYPE_TRANSMIT_STATUS = ((byte)0x8B);
+  const byte TYPE_RECEIVE_PACKET = ((byte)0x90);
+  const byte TYPE_EXPLICIT_RECEIVE = ((byte)0x91);
   const byte TYPE_IO_SAMPLE = 0x92;
+  const byte TYPE_NODE_IDENTIFICATION = 0x95;
+  const byte TYPE_ROUTE_RECORD = 0xA1;
+
+  const unsigned short MAX_DATA_LENGTH = 255;  // of a command parameter or an RF payload
+
+  const long FRAME_MARGIN = 100;  // ms a frame may take beyond its time on the line
 
   class FrameHeader {
   public:
     FrameHeader();
-    int read(int fd, long timeout = 0);
+    int read(int fd, long timeout = 0, long byteTime = 0);
     unsigned short getLength() const;
     byte getType() const;
 
   public:
+    // a longer header length can only come from line noise
+    static unsigned short getMaxLength(byte type) {
+      switch (type) {
+      case TYPE_TRANSMIT_STATUS:
+	return 7;
+      case TYPE_IO_SAMPLE:
+	return 32;
+      case TYPE_NODE_IDENTIFICATION:
+	return 64;
+      case TYPE_ROUTE_RECORD:
+	return 13 + (2 * 50);
+      case TYPE_COMMAND_RESPONSE:
+	return 5 + MAX_DATA_LENGTH;
+      case TYPE_REMOTE_COMMAND_RESPONSE:
+	return 15 + MAX_DATA_LENGTH;
+      case TYPE_RECEIVE_PACKET:
+	return 12 + MAX_DATA_LENGTH;
+      case TYPE_EXPLICIT_RECEIVE:
+	return 18 + MAX_DATA_LENGTH;
+      default:
+	return 32 + MAX_DATA_LENGTH;
+      }
+    }
+
     static std::string getTypeCode(byte type) {
       static char buffer[5];
       switch (type) {
       case TYPE_COMMAND:
 	return " C ";
+      case TYPE_COMMAND_QUEUE:
+	return " Q ";
+      case TYPE_TRANSMIT_REQUEST:
+	return "TX ";
+      case TYPE_EXPLICIT_TRANSMIT:
+	return "TXE";
+      case TYPE_TRANSMIT_STATUS:
+	return "TXS";
+      case TYPE_RECEIVE_PACKET:
+	return "RX ";
+      case TYPE_EXPLICIT_RECEIVE:
+	return "RXE";
       case TYPE_COMMAND_RESPONSE:
 	return " CR";
       case TYPE_REMOTE_COMMAND:
 	return "RC ";
+      case TYPE_CREATE_SOURCE_ROUTE:
+	return "SR ";
       case TYPE_REMOTE_COMMAND_RESPONSE:
 	return "RCR";
       case TYPE_IO_SAMPLE:
 	return "IO ";
+      case TYPE_NODE_IDENTIFICATION:
+	return "NI ";
+      case TYPE_ROUTE_RECORD:
+	return "RR ";
       default:
 	snprintf(buffer, 4, "%02X", type);
 	return buffer;
@@ -56,6 +114,7 @@ namespace XB {
 
   
   const int ERROR_CHECKSUM = -42;
+  const int ERROR_FRAME_LENGTH = -43;
 
   const byte STATUS_OK = 0;
   const byte STATUS_ERROR = 0x01;
@@ -70,6 +129,7 @@ namespace XB {
     virtual ~Frame();
     byte getType() const;
     int write(int fd);
+    int encode(Buffer* buffer);
     int read(int fd);
     int readFromHeader(int fd, FrameHeader* header);
 
@@ -88,11 +148,41 @@ namespace XB {
     int writeAccumulate(int fd, byte* data, unsigned short length = 1);
     int readAccumulate(int fd, byte* data, unsigned short length = 1);
     void accumulate(byte* data, unsigned short length = 1);
+    int writeFields(int fd, byte* data, unsigned short length);
+    int readFields(int fd, byte* data, unsigned short length);
+
+    // the fixed-size fields of L in one read or write, see Layout
+    template<typename L, typename F>
+      int readLayout(int fd, F* frame) {
+      byte data[L::size];
+      int result = readFields(fd, data, L::size);
+      if (result != 0) {
+	return result;
+      }
+
+      L::decode(frame, data);
+      return 0;
+    }
+
+    template<typename L, typename F>
+      int writeLayout(int fd, const F* frame) {
+      byte data[L::size];
+      L::encode(frame, data);
+
+      return writeFields(fd, data, L::size);
+    }
+
+  private:
+    int output(int fd, byte* data, unsigned short length = 1);
+    int _output(int fd, byte* data, unsigned short length = 1);
     
   protected:
     static byte start_;
     byte type_;
     byte checksum_;
+
+  private:
+    Buffer* output_;  // while encoding, the write chain appends here instead of writing to fd
   };
 
 
@@ -85,7 +85,7 @@ namespace XB {
   }
 
   int IOSampleFrame::readPayload(int fd, unsigned short length) {
-    int result = readAccumulate(fd, (byte*)&address64_, sizeof(address64_));
+    int result = readLayout<Fields>(fd, this);
     if (result != 0) {
       return result;
     }
@@ -93,44 +93,10 @@ namespace XB {
     if (DEBUG_FRAMES) {
       _log(" @");
       _logData((byte*)&address64_, sizeof(address64_));
-    }
-      
-    result = readAccumulate(fd, (byte*)&address16_, sizeof(address16_));
-    if (result != 0) {
-      return result;
-    }
-
-    if (DEBUG_FRAMES) {
       _log(",@");
       _logData((byte*)&address16_, sizeof(address16_));
-    }
-      
-    result = readAccumulate(fd, &receiveOptions_);
-    if (result != 0) {
-      return result;
-    }
-
-    result = readAccumulate(fd, &sampleCount_);
-    if (result != 0) {
-      return result;
-    }
-
-    result = readAccumulate(fd, (byte*)&digitalMask_, sizeof(digitalMask_));
-    if (result != 0) {
-      return result;
-    }
-
-    if (DEBUG_FRAMES) {
       _log(" ");
       _logData((byte*)&digitalMask_, sizeof(digitalMask_));
-    }
-    
-    result = readAccumulate(fd, &analogMask_);
-    if (result != 0) {
-      return result;
-    }
-
-    if (DEBUG_FRAMES) {
       _log("/");
       _logData(&analogMask_);
       _log(" =");
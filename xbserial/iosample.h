@@ -70,6 +70,14 @@ namespace XB {
     byte analogMask_;
     Sample digitalSample_;
     std::vector<Sample> analogSamples_;
+
+  private:
+    typedef Layout<Field<&IOSampleFrame::address64_>,
+      Field<&IOSampleFrame::address16_>,
+      Field<&IOSampleFrame::receiveOptions_>,
+      Field<&IOSampleFrame::sampleCount_>,
+      Field<&IOSampleFrame::digitalMask_>,
+      Field<&IOSampleFrame::analogMask_> > Fields;
   };
 }
 
@@ -0,0 +1,86 @@
+/***********************************************************/
+/* layout                                                  */
+/***********************************************************/
+
+#ifndef _LAYOUT_H_
+#define _LAYOUT_H_
+
+#include <cstddef>
+#include <string.h>
+#include <type_traits>
+
+#include "file.h"
+
+namespace XB {
+
+  template<typename M>
+    struct MemberTraits;
+
+  template<typename C, typename T>
+    struct MemberTraits<T C::*> {
+    typedef C Class;
+    typedef T Type;
+  };
+
+  // one field of a frame, kept in wire order by the member it names
+  template<auto Member>
+    struct Field {
+    typedef typename MemberTraits<decltype(Member)>::Class Class;
+    typedef typename MemberTraits<decltype(Member)>::Type Type;
+    static_assert(std::is_trivially_copyable<Type>::value, "a field is copied to and from the wire as is");
+
+    static constexpr std::size_t size = sizeof(Type);
+
+    static void decode(Class* frame, const byte* data) {
+      memcpy(&(frame->*Member), data, size);
+    }
+
+    static void encode(const Class* frame, byte* data) {
+      memcpy(data, &(frame->*Member), size);
+    }
+  };
+
+  template<std::size_t Offset, typename... Fields>
+    struct FieldsAt;
+
+  template<std::size_t Offset>
+    struct FieldsAt<Offset> {
+    static constexpr std::size_t size = 0;
+
+    template<typename F>
+    static void decode(F* frame, const byte* data) {
+    }
+
+    template<typename F>
+    static void encode(const F* frame, byte* data) {
+    }
+  };
+
+  template<std::size_t Offset, typename Head, typename... Tail>
+    struct FieldsAt<Offset, Head, Tail...> {
+    typedef FieldsAt<Offset + Head::size, Tail...> Rest;
+
+    static constexpr std::size_t offset = Offset;
+    static constexpr std::size_t size = Head::size + Rest::size;
+
+    template<typename F>
+    static void decode(F* frame, const byte* data) {
+      Head::decode(frame, data + Offset);
+      Rest::decode(frame, data);
+    }
+
+    template<typename F>
+    static void encode(const F* frame, byte* data) {
+      Head::encode(frame, data + Offset);
+      Rest::encode(frame, data);
+    }
+  };
+
+  // a run of fixed-size fields, declared once per frame type in wire order. Offsets and the
+  // total size are worked out at compile time, so decode and encode are straight-line copies
+  template<typename... Fields>
+    struct Layout : FieldsAt<0, Fields...> {
+  };
+}
+
+#endif // _LAYOUT_H_
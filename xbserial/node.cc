@@ -0,0 +1,116 @@
+/***********************************************************/
+/* node                                                    */
+/***********************************************************/
+
+#include "node.h"
+
+#include "log.h"
+
+namespace XB {
+
+  NodeIdentificationFrame::NodeIdentificationFrame(byte type) : Frame(type) {
+    receiveOptions_ = 0;
+    deviceType_ = 0;
+    sourceEvent_ = 0;
+  }
+
+  NodeIdentificationFrame::NodeIdentificationFrame(FrameHeader* header) : Frame(header) {
+    receiveOptions_ = 0;
+    deviceType_ = 0;
+    sourceEvent_ = 0;
+  }
+
+  NodeIdentificationFrame::~NodeIdentificationFrame() {
+  }
+
+  Address64 NodeIdentificationFrame::getAddress64() const {
+    return address64_;
+  }
+
+  Address16 NodeIdentificationFrame::getAddress16() const {
+    return address16_;
+  }
+
+  byte NodeIdentificationFrame::getReceiveOptions() const {
+    return receiveOptions_;
+  }
+
+  Address64 NodeIdentificationFrame::getRemoteAddress64() const {
+    return remoteAddress64_;
+  }
+
+  Address16 NodeIdentificationFrame::getRemoteAddress16() const {
+    return remoteAddress16_;
+  }
+
+  std::string NodeIdentificationFrame::getIdentifier() const {
+    return identifier_;
+  }
+
+  Address16 NodeIdentificationFrame::getParentAddress16() const {
+    return parentAddress16_;
+  }
+
+  byte NodeIdentificationFrame::getDeviceType() const {
+    return deviceType_;
+  }
+
+  byte NodeIdentificationFrame::getSourceEvent() const {
+    return sourceEvent_;
+  }
+
+  Module NodeIdentificationFrame::getModule() const {
+    return Module(remoteAddress64_, remoteAddress16_, identifier_);
+  }
+
+  int NodeIdentificationFrame::readPayload(int fd, unsigned short length) {
+    // the addresses and options alone take 21 bytes, a shorter payload is line noise
+    if (length < Fields::size) {
+      return logError(-1, "Node identification of %d bytes", length);
+    }
+
+    int result = readLayout<Fields>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" @");
+      _logData((byte*)&address64_, sizeof(address64_));
+      _log(",@");
+      _logData((byte*)&address16_, sizeof(address16_));
+    }
+
+    // NI (null terminated), parent, device type, source event, profile, manufacturer
+    unsigned short remaining = length - Fields::size;
+    byte* data = new byte[remaining];
+    result = readAccumulate(fd, data, remaining);
+    if (result != 0) {
+      delete [] data;
+      return result;
+    }
+
+    unsigned short index = 0;
+    while ((index < remaining) && (data[index] != 0)) {
+      index++;
+    }
+    identifier_ = std::string((char*)data, index);
+    index++;
+
+    if ((index + sizeof(parentAddress16_) + sizeof(deviceType_) + sizeof(sourceEvent_)) <= remaining) {
+      parentAddress16_ = Address16(data + index);
+      index += sizeof(parentAddress16_);
+      deviceType_ = data[index++];
+      sourceEvent_ = data[index++];
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" '%s' @", identifier_.c_str());
+      _logData((byte*)&remoteAddress64_, sizeof(remoteAddress64_));
+      _log(" %02X/%02X", deviceType_, sourceEvent_);
+    }
+
+    delete [] data;
+    return 0;
+  }
+}
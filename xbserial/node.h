@@ -0,0 +1,61 @@
+/***********************************************************/
+/* node                                                    */
+/***********************************************************/
+
+#ifndef _NODE_H_
+#define _NODE_H_
+
+#include "frame.h"
+#include "command.h"
+
+namespace XB {
+
+  const byte DEVICE_COORDINATOR = 0x00;
+  const byte DEVICE_ROUTER = 0x01;
+  const byte DEVICE_END_DEVICE = 0x02;
+
+  const byte EVENT_PUSHBUTTON = 0x01;
+  const byte EVENT_JOINED = 0x02;
+  const byte EVENT_POWER_CYCLE = 0x03;
+
+  // sent when a module joins (JN=1), is power cycled, or its commissioning button is pressed
+  class NodeIdentificationFrame : public Frame {
+  public:
+    NodeIdentificationFrame(byte type = TYPE_NODE_IDENTIFICATION);
+    NodeIdentificationFrame(FrameHeader* header);
+    virtual ~NodeIdentificationFrame();
+    Address64 getAddress64() const;
+    Address16 getAddress16() const;
+    byte getReceiveOptions() const;
+    Address64 getRemoteAddress64() const;
+    Address16 getRemoteAddress16() const;
+    std::string getIdentifier() const;
+    Address16 getParentAddress16() const;
+    byte getDeviceType() const;
+    byte getSourceEvent() const;
+    Module getModule() const;
+
+  protected:
+    virtual int readPayload(int fd, unsigned short length);
+
+  private:
+    Address64 address64_;
+    Address16 address16_;
+    byte receiveOptions_;
+    Address16 remoteAddress16_;
+    Address64 remoteAddress64_;
+    std::string identifier_;
+    Address16 parentAddress16_;
+    byte deviceType_;
+    byte sourceEvent_;
+
+  private:
+    typedef Layout<Field<&NodeIdentificationFrame::address64_>,
+      Field<&NodeIdentificationFrame::address16_>,
+      Field<&NodeIdentificationFrame::receiveOptions_>,
+      Field<&NodeIdentificationFrame::remoteAddress16_>,
+      Field<&NodeIdentificationFrame::remoteAddress64_> > Fields;
+  };
+}
+
+#endif // _NODE_H_
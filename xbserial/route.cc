@@ -0,0 +1,143 @@
+/***********************************************************/
+/* route                                                   */
+/***********************************************************/
+
+#include "route.h"
+
+#include "log.h"
+
+namespace XB {
+
+  RouteRecordFrame::RouteRecordFrame(byte type) : Frame(type) {
+    receiveOptions_ = 0;
+  }
+
+  RouteRecordFrame::RouteRecordFrame(FrameHeader* header) : Frame(header) {
+    receiveOptions_ = 0;
+  }
+
+  RouteRecordFrame::~RouteRecordFrame() {
+  }
+
+  Address64 RouteRecordFrame::getAddress64() const {
+    return address64_;
+  }
+
+  Address16 RouteRecordFrame::getAddress16() const {
+    return address16_;
+  }
+
+  byte RouteRecordFrame::getReceiveOptions() const {
+    return receiveOptions_;
+  }
+
+  const Route& RouteRecordFrame::getRoute() const {
+    return route_;
+  }
+
+  int RouteRecordFrame::readPayload(int fd, unsigned short length) {
+    byte count;
+    if (length < Fields::size + sizeof(count)) {
+      log("Route record of %u bytes", length);
+      return ERROR_FRAME_LENGTH;
+    }
+
+    int result = readLayout<Fields>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" @");
+      _logData((byte*)&address64_, sizeof(address64_));
+      _log(",@");
+      _logData((byte*)&address16_, sizeof(address16_));
+    }
+
+    result = readAccumulate(fd, &count);
+    if (result != 0) {
+      return result;
+    }
+
+    // the count comes off the wire, hops beyond the frame would be read from whatever follows it
+    if ((count * sizeof(Address16)) > (std::size_t)(length - Fields::size - sizeof(count))) {
+      log("Route record of %u hops in %u bytes", count, length);
+      return ERROR_FRAME_LENGTH;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" >");
+    }
+
+    route_.reserve(count);
+    for (byte index = 0; index < count; index++) {
+      Address16 hop;
+      result = readAccumulate(fd, (byte*)&hop, sizeof(hop));
+      if (result != 0) {
+	return result;
+      }
+      route_.push_back(hop);
+
+      if (DEBUG_FRAMES) {
+	_log(" ");
+	_logData((byte*)&hop, sizeof(hop));
+      }
+    }
+
+    return 0;
+  }
+
+
+  CreateSourceRouteFrame::CreateSourceRouteFrame(Address64 address64, Address16 address16, const Route& route) : Frame(TYPE_CREATE_SOURCE_ROUTE) {
+    id_ = 0;  // the radio never answers this frame
+    address64_ = address64;
+    address16_ = address16;
+    options_ = 0;
+    route_ = route;
+  }
+
+  CreateSourceRouteFrame::~CreateSourceRouteFrame() {
+  }
+
+  unsigned short CreateSourceRouteFrame::getPayloadLength() {
+    return sizeof(id_) + Fields::size + sizeof(byte) + (route_.size() * sizeof(Address16)) + Frame::getPayloadLength();
+  }
+
+  int CreateSourceRouteFrame::writePayloadPrologue(int fd) {
+    int result = Frame::writePayloadPrologue(fd);
+    if (result != 0) {
+      return result;
+    }
+
+    return writeAccumulate(fd, &id_);
+  }
+
+  int CreateSourceRouteFrame::writePayload(int fd) {
+    int result = writeLayout<Fields>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" @");
+      _logData((byte*)&address64_, sizeof(address64_));
+      _log(",@");
+      _logData((byte*)&address16_, sizeof(address16_));
+    }
+
+    byte count = (byte)route_.size();
+    result = writeAccumulate(fd, &count);
+    if (result != 0) {
+      return result;
+    }
+
+    for (Route::iterator it = route_.begin(); it != route_.end(); it++) {
+      result = writeAccumulate(fd, (byte*)&(*it), sizeof(*it));
+      if (result != 0) {
+	return result;
+      }
+    }
+
+    return Frame::writePayload(fd);
+  }
+}
@@ -0,0 +1,69 @@
+/***********************************************************/
+/* route                                                   */
+/***********************************************************/
+
+#ifndef _ROUTE_H_
+#define _ROUTE_H_
+
+#include <vector>
+
+#include "frame.h"
+#include "command.h"
+
+namespace XB {
+
+  typedef std::vector<Address16> Route;  // intermediate hops, closest to the destination first
+
+  // received when a module sends to a many-to-one (AR) concentrator
+  class RouteRecordFrame : public Frame {
+  public:
+    RouteRecordFrame(byte type = TYPE_ROUTE_RECORD);
+    RouteRecordFrame(FrameHeader* header);
+    virtual ~RouteRecordFrame();
+    Address64 getAddress64() const;
+    Address16 getAddress16() const;
+    byte getReceiveOptions() const;
+    const Route& getRoute() const;
+
+  protected:
+    virtual int readPayload(int fd, unsigned short length);
+
+  private:
+    Address64 address64_;
+    Address16 address16_;
+    byte receiveOptions_;
+    Route route_;
+
+  private:
+    typedef Layout<Field<&RouteRecordFrame::address64_>,
+      Field<&RouteRecordFrame::address16_>,
+      Field<&RouteRecordFrame::receiveOptions_> > Fields;
+  };
+
+
+  // makes the next transmission to the destination follow route rather than AODV discovery
+  class CreateSourceRouteFrame : public Frame {
+  public:
+    CreateSourceRouteFrame(Address64 address64, Address16 address16, const Route& route);
+    virtual ~CreateSourceRouteFrame();
+
+  protected:
+    virtual unsigned short getPayloadLength();
+    virtual int writePayloadPrologue(int fd);
+    virtual int writePayload(int fd);
+
+  private:
+    byte id_;
+    Address64 address64_;
+    Address16 address16_;
+    byte options_;
+    Route route_;
+
+  private:
+    typedef Layout<Field<&CreateSourceRouteFrame::address64_>,
+      Field<&CreateSourceRouteFrame::address16_>,
+      Field<&CreateSourceRouteFrame::options_> > Fields;
+  };
+}
+
+#endif // _ROUTE_H_
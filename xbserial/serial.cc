@@ -7,6 +7,7 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 
 #include "file.h"
 #include "log.h"
@@ -16,15 +17,48 @@ namespace XB {
   Serial::Serial() {
     fd_ = -1;
     idSequence_ = 0;
+    byteTime_ = 0;
   }
 
-  Serial::Serial(const char* dev, int baud) {
+  Serial::Serial(const char* dev, int baud, FlowControl flowControl) {
     fd_ = -1;
     idSequence_ = 0;
-    open(dev, baud);
+    byteTime_ = 0;
+    open(dev, baud, flowControl);
   }
 
-  int Serial::open(const char* dev, int baud) {
+  static speed_t speed(int baud) {
+    switch (baud) {
+    case 1200:
+      return B1200;
+    case 2400:
+      return B2400;
+    case 4800:
+      return B4800;
+    case 9600:
+      return B9600;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 230400:
+      return B230400;
+    default:
+      return B0;
+    }
+  }
+
+  int Serial::open(const char* dev, int baud, FlowControl flowControl) {
+    speed_t baudSpeed = speed(baud);
+    if (baudSpeed == B0) {
+      return ERROR_IBAUD;
+    }
+
+
     fd_ = ::open(dev, O_RDWR | O_NOCTTY /*| O_NDELAY*/);
     if (fd_ < 0) {
       return fd_;
@@ -33,22 +67,30 @@ namespace XB {
     if (!isatty(fd_)) {
       return ERROR_IDEV;
     }
+    byteTime_ = 10000000 / baud;  // us for 8N1
 
     struct termios config;
     if (tcgetattr(fd_, &config) < 0) {
       return ERROR_IDEV;
     }
 
-    config.c_iflag &= ~(IGNBRK | BRKINT | ICRNL | INLCR | PARMRK | INPCK | ISTRIP | IXON);
+    config.c_iflag &= ~(IGNBRK | BRKINT | ICRNL | INLCR | PARMRK | INPCK | ISTRIP | IXON | IXOFF | IXANY);
     config.c_oflag = 0;
     config.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
-    config.c_cflag &= ~(CSIZE | PARENB);
-    config.c_cflag |= CS8;
+    config.c_cflag &= ~(CSIZE | PARENB | CRTSCTS);
+    config.c_cflag |= CS8 | CLOCAL | CREAD;
+
+    if (flowControl == FLOW_HARDWARE) {
+      config.c_cflag |= CRTSCTS;
+    }
+    else if (flowControl == FLOW_SOFTWARE) {
+      config.c_iflag |= IXON | IXOFF;
+    }
 
     config.c_cc[VMIN] = 1;
     config.c_cc[VTIME] = 0;
 
-    if ((cfsetispeed(&config, B9600) < 0) || (cfsetospeed(&config, B9600) < 0)) {
+    if ((cfsetispeed(&config, baudSpeed) < 0) || (cfsetospeed(&config, baudSpeed) < 0)) {
       return ERROR_IBAUD;
     }
 
@@ -60,6 +102,7 @@ namespace XB {
   }
 
   int Serial::close() {
+    fdforget(fd_);
     return ::close(fd_);
   }
 
@@ -75,6 +118,38 @@ namespace XB {
     return send((Frame*)&frame);
   }
 
+  // bytes thrown away while looking for the start of a good frame
+  unsigned long Serial::getDiscardedBytes() {
+    return fddiscarded(fd_);
+  }
+
+  // bytes written but still in the driver's output queue, or negative
+  int Serial::getOutputPending() {
+    if (fd_ < 0) {
+      return ERROR_NOPEN;
+    }
+
+    int pending = 0;
+    if (ioctl(fd_, TIOCOUTQ, &pending) < 0) {
+      return -1;
+    }
+
+    return pending;
+  }
+
+  // already encoded frames, see Frame::encode
+  int Serial::write(const Buffer& buffer) {
+    if (fd_ < 0) {
+      return ERROR_NOPEN;
+    }
+
+    if (buffer.empty()) {
+      return 0;
+    }
+
+    return _fdwrite(fd_, &buffer[0], buffer.size());
+  }
+
   int Serial::receive(Frame* frame) {
     if (fd_ < 0) {
       return ERROR_NOPEN;
@@ -95,29 +170,68 @@ namespace XB {
     return ++idSequence_;
   }
 
+  // after line noise or a frame cut short, scanning resumes at the byte after its delimiter,
+  // so the next good frame is found even if it started inside the bad one
+  int Serial::readHeader(FrameHeader* header, long timeout) {
+    int result;
+    while ((result = header->read(fd_, timeout, byteTime_)) == ERROR_FRAME_LENGTH) {
+      fdreset(fd_, 1);
+    }
+
+    if (result != 0) {
+      fdreset(fd_, 1);
+    }
+
+    return result;
+  }
+
   Frame* Serial::receiveAny(long timeout) {
+    const FrameRoute* route;
+    Frame* frame = receiveAny(timeout, &route);
+    dispatcher_.reclaim();
+    return frame;
+  }
+
+  // reads the next frame and hands it to its type's handler, frames of types without one are dropped
+  int Serial::dispatchAny(long timeout) {
+    const FrameRoute* route;
+    Frame* frame = receiveAny(timeout, &route);
+    if (frame == NULL) {
+      dispatcher_.reclaim();
+      return -1;
+    }
+
+    if (route->handler != NULL) {
+      route->handler(frame, route->context);
+    }
+    else {
+      delete frame;
+    }
+
+    // done with the route, entries replaced meanwhile can go
+    dispatcher_.reclaim();
+    return 0;
+  }
+
+  // decoders and handlers by frame type, see FrameDispatcher
+  FrameDispatcher* Serial::getDispatcher() {
+    return &dispatcher_;
+  }
+
+  // route is the dispatcher entry the frame was decoded with
+  Frame* Serial::receiveAny(long timeout, const FrameRoute** route) {
     FrameHeader header;
-    while (header.read(fd_, timeout) >= 0) {
-      byte type = header.getType();
-      Frame *frame;
-      switch (type) {
-      case TYPE_COMMAND_RESPONSE:
-	frame = new CommandResponseFrame(&header);
-	break;
-      case TYPE_REMOTE_COMMAND_RESPONSE:
-	frame = new RemoteCommandResponseFrame(&header);
-	break;
-      case TYPE_IO_SAMPLE:
-	frame = new IOSampleFrame(&header);
-	break;
-      default:
-	frame = new Frame(&header);
-	break;
-      }
+    while (readHeader(&header, timeout) >= 0) {
+      *route = dispatcher_.find(header.getType());
+      Frame* frame = (*route)->decoder(&header);
 
       int result = receiveFromHeader(&header, frame);
       if (result != 0) {
 	delete frame;
+	fdreset(fd_, 1);
+	if (result == ERROR_CHECKSUM) {
+	  continue;
+	}
 	return NULL;
       }
 
@@ -129,7 +243,7 @@ namespace XB {
 
   CommandResponseFrame* Serial::receiveCommandResponse(byte id, long timeout) {
     FrameHeader header;
-    while (header.read(fd_, timeout) >= 0) {
+    while (readHeader(&header, timeout) >= 0) {
       byte type = header.getType();
       CommandResponseFrame *frame;
       switch (type) {
@@ -146,6 +260,10 @@ namespace XB {
       int result = receiveFromHeader(&header, frame);
       if (result != 0) {
 	delete frame;
+	fdreset(fd_, 1);
+	if (result == ERROR_CHECKSUM) {
+	  continue;
+	}
 	return NULL;
       }
 
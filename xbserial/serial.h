@@ -7,6 +7,10 @@
 #include "frame.h"
 #include "command.h"
 #include "iosample.h"
+#include "node.h"
+#include "route.h"
+#include "transmit.h"
+#include "dispatch.h"
 
 namespace XB {
 
@@ -16,16 +20,27 @@ namespace XB {
 
   const byte NO_TIMEOUT = 0;
 
+  enum FlowControl {
+    FLOW_NONE,
+    FLOW_HARDWARE,  // RTS/CTS, D6=1 and D7=1 on the radio
+    FLOW_SOFTWARE  // XON/XOFF, needs API mode 2 (AP=2) so frames never carry them unescaped
+  };
+
   class Serial {
   public:
     Serial();
-    Serial(const char* dev, int baud);
-    int open(const char* dev, int baud);
+    Serial(const char* dev, int baud, FlowControl flowControl = FLOW_NONE);
+    int open(const char* dev, int baud, FlowControl flowControl = FLOW_NONE);
     int close();
     int send(Frame* frame);
     int send(const Frame& frame);
+    int write(const Buffer& buffer);
+    int getOutputPending();
+    unsigned long getDiscardedBytes();
     int receive(Frame* frame);
     Frame* receiveAny(long timeout = NO_TIMEOUT);
+    int dispatchAny(long timeout = NO_TIMEOUT);
+    FrameDispatcher* getDispatcher();
     CommandResponseFrame* receiveCommandResponse(byte id, long timeout = NO_TIMEOUT);
     CommandResponseFrame* sendCommandForResponse(CommandFrame* frame);
     CommandResponseFrame* sendCommandForResponse(const CommandFrame& frame);
@@ -45,12 +60,16 @@ namespace XB {
     int setRemoteParameter(Module* module, Command command, Parameter parameter, byte options = 0);
     
   private:
+    int readHeader(FrameHeader* header, long timeout);
     int receiveFromHeader(FrameHeader* header, Frame* frame);
+    Frame* receiveAny(long timeout, const FrameRoute** route);
     byte getNextId();
     
   private:
     int fd_;
     byte idSequence_;
+    long byteTime_;  // us per byte on the line, bounds how long a frame may take to arrive
+    FrameDispatcher dispatcher_;
   };
 
 }
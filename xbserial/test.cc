@@ -8,13 +8,386 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "log.h"
+#include "node.h"
+#include "route.h"
+#include "transmit.h"
 
 using namespace XB;
 
+static int failures = 0;
+
+bool check(bool passed, const char* condition, const char* file, int line) {
+  if (!passed) {
+    log("%s:%d: %s failed", file, line, condition);
+    failures++;
+  }
+
+  return passed;
+}
+
+// the wire bytes of a frame of type with payload: delimiter, length, escaped contents, checksum
+static Buffer frameBytes(byte type, const Buffer& payload) {
+  byte header[2];
+  unsigned short total = payload.size() + 1;
+  header[0] = (byte)(total >> 8);
+  header[1] = (byte)total;
+
+  byte sum = type;
+  for (Buffer::const_iterator it = payload.begin(); it != payload.end(); it++) {
+    sum += *it;
+  }
+  byte checksum = 0xFF - sum;
+
+  Buffer buffer;
+  _bufwrite(&buffer, &START_DELIMITER);
+  bufwrite(&buffer, header, 2);
+  bufwrite(&buffer, &type);
+  if (!payload.empty()) {
+    bufwrite(&buffer, &payload[0], payload.size());
+  }
+  bufwrite(&buffer, &checksum);
+
+  return buffer;
+}
+
+// a read end with bytes waiting and the write end already closed, so nothing blocks
+static int pipeOf(const Buffer& bytes) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return -1;
+  }
+
+  _fdwrite(fds[1], &bytes[0], bytes.size());
+  close(fds[1]);
+  fdforget(fds[0]);
+
+  return fds[0];
+}
+
+static void append(Buffer* buffer, const byte* data, std::size_t length) {
+  buffer->insert(buffer->end(), data, data + length);
+}
+
+template<typename F>
+  static F* readFrame(int fd, int* result) {
+  FrameHeader header;
+  *result = header.read(fd);
+  if (*result != 0) {
+    return NULL;
+  }
+
+  F* frame = new F(&header);
+  *result = frame->readFromHeader(fd, &header);
+  return frame;
+}
+
+static void testNodeIdentificationLength() {
+  byte address64[] = {0x00, 0x13, 0xA2, 0x00, 0x41, 0x46, 0xB5, 0xA9};
+  byte address16[] = {0x12, 0x34};
+  Buffer payload;
+  append(&payload, address64, sizeof(address64));
+  append(&payload, address16, sizeof(address16));
+  payload.push_back(0x02);
+  append(&payload, address16, sizeof(address16));
+  append(&payload, address64, sizeof(address64));
+  append(&payload, (const byte*)"Kitchen", 8);
+  byte rest[] = {0xFF, 0xFE, DEVICE_END_DEVICE, EVENT_JOINED, 0xC1, 0x05, 0x10, 0x1E};
+  append(&payload, rest, sizeof(rest));
+
+  int result;
+  int fd = pipeOf(frameBytes(TYPE_NODE_IDENTIFICATION, payload));
+  NodeIdentificationFrame* frame = readFrame<NodeIdentificationFrame>(fd, &result);
+  CHECK(result == 0);
+  CHECK(frame->getIdentifier() == "Kitchen");
+  CHECK(frame->getRemoteAddress64() == Address64(address64));
+  CHECK(frame->getDeviceType() == DEVICE_END_DEVICE);
+  delete frame;
+  close(fd);
+
+  // shorter than its addresses and options
+  payload.resize(12);
+  fd = pipeOf(frameBytes(TYPE_NODE_IDENTIFICATION, payload));
+  frame = readFrame<NodeIdentificationFrame>(fd, &result);
+  CHECK(result != 0);
+  delete frame;
+  close(fd);
+}
+
+static void testRouteRecordLength() {
+  byte addresses[] = {0x00, 0x13, 0xA2, 0x00, 0x41, 0x46, 0xB5, 0xA9, 0x12, 0x34, 0x01};
+  byte hops[] = {0xAB, 0xCD, 0x56, 0x78};
+  Buffer payload;
+  append(&payload, addresses, sizeof(addresses));
+  payload.push_back(2);
+  append(&payload, hops, sizeof(hops));
+
+  int result;
+  int fd = pipeOf(frameBytes(TYPE_ROUTE_RECORD, payload));
+  RouteRecordFrame* frame = readFrame<RouteRecordFrame>(fd, &result);
+  CHECK(result == 0);
+  CHECK(frame->getRoute().size() == 2);
+  CHECK(frame->getRoute()[1] == Address16(0x56, 0x78));
+  delete frame;
+  close(fd);
+
+  // a count beyond the payload, with the next frame right behind it
+  payload[sizeof(addresses)] = 200;
+  Buffer bytes = frameBytes(TYPE_ROUTE_RECORD, payload);
+  Buffer next = frameBytes(TYPE_ROUTE_RECORD, Buffer(payload.begin(), payload.begin() + sizeof(addresses) + 1));
+  bytes.insert(bytes.end(), next.begin(), next.end());
+  fd = pipeOf(bytes);
+  frame = readFrame<RouteRecordFrame>(fd, &result);
+  CHECK(result == ERROR_FRAME_LENGTH);
+  delete frame;
+  close(fd);
+
+  // too short for the count at all
+  fd = pipeOf(frameBytes(TYPE_ROUTE_RECORD, Buffer(payload.begin(), payload.begin() + 6)));
+  frame = readFrame<RouteRecordFrame>(fd, &result);
+  CHECK(result == ERROR_FRAME_LENGTH);
+  delete frame;
+  close(fd);
+}
+
+static void testReceiveFrames() {
+  byte addresses[] = {0x00, 0x13, 0xA2, 0x00, 0x41, 0x46, 0xB5, 0xA9, 0x12, 0x34, 0x01};
+  Buffer payload;
+  append(&payload, addresses, sizeof(addresses));
+  append(&payload, (const byte*)"\x7E\x7Dhello", 7);
+
+  int result;
+  int fd = pipeOf(frameBytes(TYPE_RECEIVE_PACKET, payload));
+  ReceivePacketFrame* packet = readFrame<ReceivePacketFrame>(fd, &result);
+  CHECK(result == 0);
+  CHECK(packet->getAddress16() == Address16(0x12, 0x34));
+  CHECK(packet->getReceiveOptions() == 0x01);
+  CHECK((packet->getData().length == 7) && (memcmp(packet->getData().data, "\x7E\x7Dhello", 7) == 0));
+  delete packet;
+  close(fd);
+
+  byte status[] = {0x05, 0x12, 0x34, 0x00, DELIVERY_SUCCESS, 0x00};
+  fd = pipeOf(frameBytes(TYPE_TRANSMIT_STATUS, Buffer(status, status + sizeof(status))));
+  TransmitStatusFrame* transmitStatus = readFrame<TransmitStatusFrame>(fd, &result);
+  CHECK(result == 0);
+  CHECK(transmitStatus->getId() == 0x05);
+  CHECK(transmitStatus->getDeliveryStatus() == DELIVERY_SUCCESS);
+  delete transmitStatus;
+  close(fd);
+
+  // the id alone
+  fd = pipeOf(frameBytes(TYPE_TRANSMIT_STATUS, Buffer(status, status + 1)));
+  transmitStatus = readFrame<TransmitStatusFrame>(fd, &result);
+  CHECK(result == ERROR_FRAME_LENGTH);
+  delete transmitStatus;
+  close(fd);
+}
+
+// a delimiter in line noise may swallow the next real one; rescanning from the byte after it finds it again
+static void testHeaderResync() {
+  byte status[] = {0x05, 0x12, 0x34, 0x00, DELIVERY_SUCCESS, 0x00};
+  byte noise[] = {START_DELIMITER, 0xFF};
+  Buffer bytes(noise, noise + sizeof(noise));
+  Buffer frame = frameBytes(TYPE_TRANSMIT_STATUS, Buffer(status, status + sizeof(status)));
+  bytes.insert(bytes.end(), frame.begin(), frame.end());
+
+  int fd = pipeOf(bytes);
+  FrameHeader header;
+  int result = header.read(fd);
+  CHECK(result == ERROR_FRAME_LENGTH);
+  CHECK(fdreset(fd, 1) == 0);
+
+  result = header.read(fd);
+  CHECK(result == 0);
+  CHECK(header.getType() == TYPE_TRANSMIT_STATUS);
+  CHECK(header.getLength() == sizeof(status) + 1);
+
+  TransmitStatusFrame transmitStatus(&header);
+  CHECK(transmitStatus.readFromHeader(fd, &header) == 0);
+  CHECK(transmitStatus.getId() == 0x05);
+  close(fd);
+}
+
+// a frame cut short must time out at its deadline, not wait for bytes that never come
+static void testFrameDeadline() {
+  byte status[] = {0x05, 0x12, 0x34, 0x00, DELIVERY_SUCCESS, 0x00};
+  Buffer bytes = frameBytes(TYPE_TRANSMIT_STATUS, Buffer(status, status + sizeof(status)));
+
+  int fds[2];
+  if (!CHECK(pipe(fds) == 0)) {
+    return;
+  }
+  fdforget(fds[0]);
+  _fdwrite(fds[1], &bytes[0], bytes.size() - 3);
+
+  FrameHeader header;
+  CHECK(header.read(fds[0], 0, 100) == 0);
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  TransmitStatusFrame transmitStatus(&header);
+  CHECK(transmitStatus.readFromHeader(fds[0], &header) == FD_TIMEOUT);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  long elapsed = (1000 * (long)(end.tv_sec - start.tv_sec)) + ((end.tv_nsec - start.tv_nsec) / 1000000);
+  CHECK(elapsed <= FRAME_MARGIN + 100);
+
+  // the header alone, with its length still to come
+  _fdwrite(fds[1], &START_DELIMITER, 1);
+  CHECK(header.read(fds[0], 0, 100) == FD_TIMEOUT);
+
+  close(fds[1]);
+  close(fds[0]);
+}
+
+static void testParameterCopyMove() {
+  Parameter small((unsigned short)0x1234);
+  Parameter copied(small);
+  CHECK(copied.data != small.data);
+  CHECK((copied.length == 2) && (copied.ushort() == 0x1234));
+
+  Parameter moved(std::move(copied));
+  CHECK((moved.length == 2) && (moved.ushort() == 0x1234));
+  CHECK(copied.length == 0);
+
+  std::string text(PARAMETER_INLINE_SIZE + 10, 'x');
+  Parameter large(text.c_str());
+  Parameter deep(large);
+  CHECK(deep.data != large.data);
+  deep.data[0] = 'y';
+  CHECK(large.std_string() == text);
+
+  byte* heap = large.data;
+  Parameter taken(std::move(large));
+  CHECK(taken.data == heap);
+  CHECK(taken.std_string() == text);
+  CHECK((large.length == 0) && (large.std_string() == ""));
+
+  // between inline and heap storage both ways, and onto itself
+  small = taken;
+  CHECK(small.std_string() == text);
+  small = Parameter((unsigned short)0xABCD);
+  CHECK((small.length == 2) && (small.ushort() == 0xABCD));
+  taken = std::move(small);
+  CHECK(taken.ushort() == 0xABCD);
+  Parameter& same = taken;
+  taken = same;
+  CHECK(taken.ushort() == 0xABCD);
+}
+
+// escapes undone, from the type to the checksum
+static Buffer unescape(const Buffer& bytes) {
+  Buffer contents;
+  for (std::size_t index = 3; index < bytes.size(); index++) {
+    if ((bytes[index] == ESCAPE_BYTE) && ((index + 1) < bytes.size())) {
+      contents.push_back(bytes[++index] ^ ESCAPE_MASK);
+    }
+    else {
+      contents.push_back(bytes[index]);
+    }
+  }
+
+  return contents;
+}
+
+static void testRemoteCommandTemplate() {
+  // every value needs escaping somewhere
+  byte address64[] = {0x00, 0x13, 0xA2, 0x00, 0x7E, 0x46, 0x11, 0x7D};
+  byte value[] = {0x7E, 0x01, 0x13};
+  Parameter parameter(value, sizeof(value));
+  RemoteCommandTemplate remote(Address64(address64), Address16(0x12, 0x7D), OPTION_APPLY, "D0");
+
+  Buffer compiled;
+  remote.encode(0x11, parameter, &compiled);
+  Buffer encoded;
+  RemoteCommandFrame(Address64(address64), Address16(0x12, 0x7D), OPTION_APPLY, "D0", parameter, 0x11).encode(&encoded);
+  CHECK(compiled == encoded);
+
+  Buffer contents = unescape(compiled);
+  byte sum = 0;
+  for (Buffer::const_iterator it = contents.begin(); it != contents.end(); it++) {
+    sum += *it;
+  }
+  CHECK(sum == 0xFF);
+
+  // a new 16-bit address recompiles the fields
+  remote.setAddress16(UNKNOWN);
+  compiled.clear();
+  remote.encode(0x7E, Parameter(), &compiled);
+  encoded.clear();
+  RemoteCommandFrame(Address64(address64), UNKNOWN, OPTION_APPLY, "D0", Parameter(), 0x7E).encode(&encoded);
+  CHECK(compiled == encoded);
+}
+
+static void countFrame(Frame* frame, void* context) {
+  (*(int*)context)++;
+  delete frame;
+}
+
+static void otherFrame(Frame* frame, void* context) {
+  delete frame;
+}
+
+static void testDispatcher() {
+  FrameDispatcher dispatcher;
+  int count = 0;
+  byte type = 0xA5;
+
+  // a handler is required both ways, and a type takes only one
+  CHECK(dispatcher.add(type, NULL, NULL) == ERROR_FRAME_TYPE);
+  CHECK(dispatcher.find(type)->handler == NULL);
+  CHECK(dispatcher.remove(type, NULL) == ERROR_FRAME_TYPE);
+  CHECK(dispatcher.add(type, NULL, &countFrame, &count) == 0);
+  CHECK(dispatcher.add(type, NULL, &otherFrame) == ERROR_FRAME_TYPE);
+  CHECK(dispatcher.remove(type, NULL) == ERROR_FRAME_TYPE);
+  CHECK(dispatcher.remove(type, &otherFrame) == ERROR_FRAME_TYPE);
+
+  // an entry found before a change stays usable until it is reclaimed
+  const FrameRoute* route = dispatcher.find(type);
+  CHECK((route->handler == &countFrame) && (route->context == &count));
+  CHECK(dispatcher.remove(type, &countFrame) == 0);
+  CHECK(dispatcher.find(type)->handler == NULL);
+
+  byte status[] = {0x05, 0x12, 0x34, 0x00, DELIVERY_SUCCESS, 0x00};
+  int fd = pipeOf(frameBytes(type, Buffer(status, status + sizeof(status))));
+  FrameHeader header;
+  CHECK(header.read(fd) == 0);
+  route->handler(route->decoder(&header), route->context);
+  CHECK(count == 1);
+  close(fd);
+  dispatcher.reclaim();
+
+  // removed, the library's decoder is back
+  CHECK(dispatcher.add(TYPE_TRANSMIT_STATUS, NULL, &countFrame, &count) == 0);
+  CHECK(dispatcher.find(TYPE_TRANSMIT_STATUS)->decoder == decodeFrame<TransmitStatusFrame>);
+  CHECK(dispatcher.remove(TYPE_TRANSMIT_STATUS, &countFrame) == 0);
+  CHECK(dispatcher.find(TYPE_TRANSMIT_STATUS)->decoder == decodeFrame<TransmitStatusFrame>);
+  dispatcher.reclaim();
+}
+
+static int runTests() {
+  testNodeIdentificationLength();
+  testRouteRecordLength();
+  testReceiveFrames();
+  testHeaderResync();
+  testFrameDeadline();
+  testParameterCopyMove();
+  testRemoteCommandTemplate();
+  testDispatcher();
+
+  log("%d failed", failures);
+  return (failures == 0) ? 0 : 1;
+}
+
+// without arguments the regression tests run, given a device it logs every frame received
 int main(int argc, char **argv) {
-  std::string dev("/dev/ttyUSB0");
+  if (argc < 2) {
+    return runTests();
+  }
+
+  std::string dev(argv[1]);
   Serial serial;
 
   int result = serial.open(dev.c_str(), 9600);
@@ -1,4 +1,9 @@
 #ifndef _TEST_H_
 #define _TEST_H_
 
+// a failed expectation is logged and counted, the run goes on
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+bool check(bool passed, const char* condition, const char* file, int line);
+
 #endif // _TEST_H_
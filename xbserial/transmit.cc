@@ -0,0 +1,309 @@
+/***********************************************************/
+/* transmit                                                */
+/***********************************************************/
+
+#include "transmit.h"
+
+#include "log.h"
+
+namespace XB {
+
+  TransmitRequestFrame::TransmitRequestFrame(Address64 address64, Address16 address16, DataView data, byte id, byte options, byte radius) : Frame(TYPE_TRANSMIT_REQUEST) {
+    id_ = id;
+    address64_ = address64;
+    address16_ = address16;
+    radius_ = radius;
+    options_ = options;
+    data_ = data;
+  }
+
+  TransmitRequestFrame::TransmitRequestFrame(byte type, Address64 address64, Address16 address16, DataView data, byte id, byte options, byte radius) : Frame(type) {
+    id_ = id;
+    address64_ = address64;
+    address16_ = address16;
+    radius_ = radius;
+    options_ = options;
+    data_ = data;
+  }
+
+  TransmitRequestFrame::~TransmitRequestFrame() {
+  }
+
+  byte TransmitRequestFrame::getId() const {
+    return id_;
+  }
+
+  Address64 TransmitRequestFrame::getAddress64() const {
+    return address64_;
+  }
+
+  unsigned short TransmitRequestFrame::getPayloadLength() {
+    return sizeof(id_) + Addresses::size + Options::size + data_.length + Frame::getPayloadLength();
+  }
+
+  int TransmitRequestFrame::writePayloadPrologue(int fd) {
+    int result = Frame::writePayloadPrologue(fd);
+    if (result != 0) {
+      return result;
+    }
+
+    result = writeAccumulate(fd, &id_);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" #%02X", id_);
+    }
+
+    return 0;
+  }
+
+  int TransmitRequestFrame::writePayload(int fd) {
+    int result = writeAddresses(fd);
+    if (result != 0) {
+      return result;
+    }
+
+    return writeData(fd);
+  }
+
+  int TransmitRequestFrame::writeAddresses(int fd) {
+    int result = writeLayout<Addresses>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" @");
+      _logData((byte*)&address64_, sizeof(address64_));
+      _log(",@");
+      _logData((byte*)&address16_, sizeof(address16_));
+    }
+
+    return 0;
+  }
+
+  int TransmitRequestFrame::writeData(int fd) {
+    int result = writeLayout<Options>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (data_.length > 0) {
+      result = writeAccumulate(fd, (byte*)data_.data, data_.length);
+      if (result != 0) {
+	return result;
+      }
+
+      if (DEBUG_FRAMES) {
+	_log(" =");
+	_logData((byte*)data_.data, data_.length);
+      }
+    }
+
+    return Frame::writePayload(fd);
+  }
+
+
+  ExplicitTransmitFrame::ExplicitTransmitFrame(Address64 address64, Address16 address16, ExplicitAddressing addressing, DataView data, byte id, byte options, byte radius) : TransmitRequestFrame(TYPE_EXPLICIT_TRANSMIT, address64, address16, data, id, options, radius) {
+    addressing_ = addressing;
+  }
+
+  ExplicitTransmitFrame::~ExplicitTransmitFrame() {
+  }
+
+  unsigned short ExplicitTransmitFrame::getPayloadLength() {
+    return Fields::size + TransmitRequestFrame::getPayloadLength();
+  }
+
+  int ExplicitTransmitFrame::writePayload(int fd) {
+    int result = writeAddresses(fd);
+    if (result != 0) {
+      return result;
+    }
+
+    result = writeLayout<Fields>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" %02X>%02X ", addressing_.sourceEndpoint, addressing_.destinationEndpoint);
+      _logData((byte*)&addressing_.clusterId, sizeof(addressing_.clusterId));
+      _log("/");
+      _logData((byte*)&addressing_.profileId, sizeof(addressing_.profileId));
+    }
+
+    return writeData(fd);
+  }
+
+
+  TransmitStatusFrame::TransmitStatusFrame(byte type) : Frame(type) {
+    id_ = 0;
+    retryCount_ = 0;
+    deliveryStatus_ = 0;
+    discoveryStatus_ = 0;
+  }
+
+  TransmitStatusFrame::TransmitStatusFrame(FrameHeader* header) : Frame(header) {
+    id_ = 0;
+    retryCount_ = 0;
+    deliveryStatus_ = 0;
+    discoveryStatus_ = 0;
+  }
+
+  TransmitStatusFrame::~TransmitStatusFrame() {
+  }
+
+  byte TransmitStatusFrame::getId() const {
+    return id_;
+  }
+
+  Address16 TransmitStatusFrame::getAddress16() const {
+    return address16_;
+  }
+
+  byte TransmitStatusFrame::getRetryCount() const {
+    return retryCount_;
+  }
+
+  byte TransmitStatusFrame::getDeliveryStatus() const {
+    return deliveryStatus_;
+  }
+
+  byte TransmitStatusFrame::getDiscoveryStatus() const {
+    return discoveryStatus_;
+  }
+
+  byte TransmitStatusFrame::getStatus() const {
+    return deliveryStatus_;
+  }
+
+  unsigned short TransmitStatusFrame::getPayloadPrologueLength() {
+    return sizeof(id_) + Frame::getPayloadPrologueLength();
+  }
+
+  int TransmitStatusFrame::readPayloadPrologue(int fd) {
+    int result = readAccumulate(fd, &id_);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" #%02X", id_);
+    }
+
+    return 0;
+  }
+
+  int TransmitStatusFrame::readPayload(int fd, unsigned short length) {
+    if (length < Fields::size) {
+      log("Transmit status of %u bytes", length);
+      return ERROR_FRAME_LENGTH;
+    }
+
+    int result = readLayout<Fields>(fd, this);
+    if (result != 0) {
+      return result;
+    }
+
+    if (DEBUG_FRAMES) {
+      _log(" ,@");
+      _logData((byte*)&address16_, sizeof(address16_));
+      _log(" %02X", deliveryStatus_);
+    }
+
+    // anything after the known fields still counts towards the checksum
+    return Frame::readPayload(fd, length - Fields::size);
+  }
+
+
+  ReceivePacketFrame::ReceivePacketFrame(byte type) : Frame(type) {
+    length_ = 0;
+  }
+
+  ReceivePacketFrame::ReceivePacketFrame(FrameHeader* header) : Frame(header) {
+    length_ = 0;
+  }
+
+  ReceivePacketFrame::~ReceivePacketFrame() {
+  }
+
+  Address64 ReceivePacketFrame::getAddress64() const {
+    return (length_ > 0) ? Address64((byte*)buffer_) : Address64();
+  }
+
+  Address16 ReceivePacketFrame::getAddress16() const {
+    return (length_ > 0) ? Address16((byte*)buffer_ + sizeof(Address64)) : UNKNOWN;
+  }
+
+  byte ReceivePacketFrame::getReceiveOptions() const {
+    return (length_ > 0) ? buffer_[getHeaderLength() - 1] : 0;
+  }
+
+  DataView ReceivePacketFrame::getData() const {
+    if (length_ == 0) {
+      return DataView();
+    }
+
+    return DataView(buffer_ + getHeaderLength(), length_ - getHeaderLength());
+  }
+
+  // 64-bit and 16-bit source, receive options
+  unsigned short ReceivePacketFrame::getHeaderLength() const {
+    return sizeof(Address64) + sizeof(Address16) + sizeof(byte);
+  }
+
+  int ReceivePacketFrame::readPayload(int fd, unsigned short length) {
+    if (length < getHeaderLength()) {
+      return Frame::readPayload(fd, length);
+    }
+
+    if (length > sizeof(buffer_)) {
+      log("Receive packet of %u bytes", length);
+      return ERROR_FRAME_LENGTH;
+    }
+
+    int result = readAccumulate(fd, buffer_, length);
+    if (result != 0) {
+      return result;
+    }
+    length_ = length;
+
+    if (DEBUG_FRAMES) {
+      _log(" ");
+      _logData(buffer_, length_);
+    }
+
+    return 0;
+  }
+
+
+  ExplicitReceiveFrame::ExplicitReceiveFrame(byte type) : ReceivePacketFrame(type) {
+  }
+
+  ExplicitReceiveFrame::ExplicitReceiveFrame(FrameHeader* header) : ReceivePacketFrame(header) {
+  }
+
+  ExplicitReceiveFrame::~ExplicitReceiveFrame() {
+  }
+
+  ExplicitAddressing ExplicitReceiveFrame::getAddressing() const {
+    ExplicitAddressing addressing;
+    if (length_ > 0) {
+      const byte* data = buffer_ + sizeof(Address64) + sizeof(Address16);
+      addressing.sourceEndpoint = data[0];
+      addressing.destinationEndpoint = data[1];
+      addressing.clusterId = _2Byte((byte*)data + 2);
+      addressing.profileId = _2Byte((byte*)data + 4);
+    }
+
+    return addressing;
+  }
+
+  // adds endpoints, cluster and profile before the receive options
+  unsigned short ExplicitReceiveFrame::getHeaderLength() const {
+    return ReceivePacketFrame::getHeaderLength() + 6;
+  }
+}
@@ -0,0 +1,169 @@
+/***********************************************************/
+/* transmit                                                */
+/***********************************************************/
+
+#ifndef _TRANSMIT_H_
+#define _TRANSMIT_H_
+
+#include "frame.h"
+#include "command.h"
+
+namespace XB {
+
+  const byte OPTION_TRANSMIT_DISABLE_RETRIES = 0x01;
+  const byte OPTION_TRANSMIT_APS_ENCRYPTION = 0x20;
+  const byte OPTION_TRANSMIT_EXTENDED_TIMEOUT = 0x40;
+
+  const byte DELIVERY_SUCCESS = 0x00;
+  const byte DELIVERY_ADDRESS_NOT_FOUND = 0x24;
+  const byte DELIVERY_ROUTE_NOT_FOUND = 0x25;
+
+  const byte MAX_BROADCAST_RADIUS = 0x00;
+
+  // of an explicit receive after its type: addresses, endpoints, cluster, profile, options and data
+  const unsigned short MAX_RECEIVE_PAYLOAD = 17 + MAX_DATA_LENGTH;
+
+  // bytes owned elsewhere: the caller's buffer on transmit, the frame's on receive
+  struct DataView {
+    const byte* data;
+    unsigned short length;
+
+    DataView() {
+      data = NULL;
+      length = 0;
+    }
+
+    DataView(const byte* data, unsigned short length) {
+      this->data = data;
+      this->length = length;
+    }
+  };
+
+  struct ExplicitAddressing {
+    byte sourceEndpoint;
+    byte destinationEndpoint;
+    _2Byte clusterId;
+    _2Byte profileId;
+
+    ExplicitAddressing() {
+      sourceEndpoint = 0xE8;
+      destinationEndpoint = 0xE8;
+      clusterId = _2Byte((byte)0x00, (byte)0x11);
+      profileId = _2Byte((byte)0xC1, (byte)0x05);
+    }
+  };
+
+  class TransmitRequestFrame : public Frame {
+  public:
+    TransmitRequestFrame(Address64 address64, Address16 address16, DataView data, byte id = 0, byte options = 0, byte radius = MAX_BROADCAST_RADIUS);
+    virtual ~TransmitRequestFrame();
+    byte getId() const;
+    Address64 getAddress64() const;
+
+  protected:
+    TransmitRequestFrame(byte type, Address64 address64, Address16 address16, DataView data, byte id, byte options, byte radius);
+    virtual unsigned short getPayloadLength();
+    virtual int writePayloadPrologue(int fd);
+    virtual int writePayload(int fd);
+    int writeAddresses(int fd);
+    int writeData(int fd);
+
+  protected:
+    byte id_;
+    Address64 address64_;
+    Address16 address16_;
+    byte radius_;
+    byte options_;
+    DataView data_;
+
+  protected:
+    typedef Layout<Field<&TransmitRequestFrame::address64_>,
+      Field<&TransmitRequestFrame::address16_> > Addresses;
+    typedef Layout<Field<&TransmitRequestFrame::radius_>,
+      Field<&TransmitRequestFrame::options_> > Options;
+  };
+
+
+  class ExplicitTransmitFrame : public TransmitRequestFrame {
+  public:
+    ExplicitTransmitFrame(Address64 address64, Address16 address16, ExplicitAddressing addressing, DataView data, byte id = 0, byte options = 0, byte radius = MAX_BROADCAST_RADIUS);
+    virtual ~ExplicitTransmitFrame();
+
+  protected:
+    virtual unsigned short getPayloadLength();
+    virtual int writePayload(int fd);
+
+  private:
+    ExplicitAddressing addressing_;
+
+  private:
+    typedef Layout<Field<&ExplicitTransmitFrame::addressing_> > Fields;
+  };
+
+
+  class TransmitStatusFrame : public Frame {
+  public:
+    TransmitStatusFrame(byte type = TYPE_TRANSMIT_STATUS);
+    TransmitStatusFrame(FrameHeader* header);
+    virtual ~TransmitStatusFrame();
+    byte getId() const;
+    Address16 getAddress16() const;
+    byte getRetryCount() const;
+    byte getDeliveryStatus() const;
+    byte getDiscoveryStatus() const;
+    virtual byte getStatus() const;
+
+  protected:
+    virtual unsigned short getPayloadPrologueLength();
+    virtual int readPayloadPrologue(int fd);
+    virtual int readPayload(int fd, unsigned short length);
+
+  private:
+    byte id_;
+    Address16 address16_;
+    byte retryCount_;
+    byte deliveryStatus_;
+    byte discoveryStatus_;
+
+  private:
+    typedef Layout<Field<&TransmitStatusFrame::address16_>,
+      Field<&TransmitStatusFrame::retryCount_>,
+      Field<&TransmitStatusFrame::deliveryStatus_>,
+      Field<&TransmitStatusFrame::discoveryStatus_> > Fields;
+  };
+
+
+  // the payload is unescaped once into the frame's own storage, fields and data are views into it
+  class ReceivePacketFrame : public Frame {
+  public:
+    ReceivePacketFrame(byte type = TYPE_RECEIVE_PACKET);
+    ReceivePacketFrame(FrameHeader* header);
+    virtual ~ReceivePacketFrame();
+    Address64 getAddress64() const;
+    Address16 getAddress16() const;
+    byte getReceiveOptions() const;
+    DataView getData() const;
+
+  protected:
+    virtual unsigned short getHeaderLength() const;
+    virtual int readPayload(int fd, unsigned short length);
+
+  protected:
+    byte buffer_[MAX_RECEIVE_PAYLOAD];
+    unsigned short length_;  // 0 until a payload was read
+  };
+
+
+  class ExplicitReceiveFrame : public ReceivePacketFrame {
+  public:
+    ExplicitReceiveFrame(byte type = TYPE_EXPLICIT_RECEIVE);
+    ExplicitReceiveFrame(FrameHeader* header);
+    virtual ~ExplicitReceiveFrame();
+    ExplicitAddressing getAddressing() const;
+
+  protected:
+    virtual unsigned short getHeaderLength() const;
+  };
+}
+
+#endif // _TRANSMIT_H_